@@ -11,76 +11,87 @@
 #define NC_QUADTREE_H_
 
 #include <vector>
+#include <array>
 #include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <iterator>
+#include <queue>
+#include <limits>
+#include <cmath>
+#include <functional>
+#include <cstring>
+#include <unordered_map>
+#include <chrono>
+
+// vector kernels for the leaf scans, define NC_QUADTREE_NO_SIMD to force
+// the scalar fallback
+#if !defined(NC_QUADTREE_NO_SIMD)
+#if defined(__AVX2__)
+#define NC_QUADTREE_SIMD_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NC_QUADTREE_SIMD_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define NC_QUADTREE_SIMD_NEON
+#include <arm_neon.h>
+#endif
+#endif
+
+// define NC_QUADTREE_STATS to count the work done by the tree into
+// nc::get_stats(), without it the counters compile to nothing
+#if defined(NC_QUADTREE_STATS)
+#define NC_QUADTREE_COUNT(_Counter, _Value) (::nc::get_stats()._Counter += (_Value))
+#else
+#define NC_QUADTREE_COUNT(_Counter, _Value) ((void)0)
+#endif
+
+#if defined(NC_QUADTREE_MMAP)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace nc {
+    // four boxes fit a 64 byte cache line for 32-bit coordinates, wider
+    // types keep their natural alignment
+    template <typename T>
+    struct QuadTreeAABBAlignment {
+        static constexpr size_t value = sizeof(T) * 4 <= 16 ? sizeof(T) * 4 : alignof(T);
+    };
+
+    // axis aligned box stored as its four edges, the center and the
+    // extent are derived on demand
     template <typename T>
-    class QuadTreeAABB {
+    class alignas(QuadTreeAABBAlignment<T>::value) QuadTreeAABB {
     public:
         // boundaries
         T left, top, right, bottom;
-        // center
-        T x, y;
-        // dimensions
-        T width, height;
-
-        QuadTreeAABB() {}
-        QuadTreeAABB(const QuadTreeAABB& _Other) :
-            left(_Other.left),
-            top(_Other.top),
-            right(_Other.right),
-            bottom(_Other.bottom),
-            x(_Other.x),
-            y(_Other.y),
-            width(_Other.width),
-            height(_Other.height) {
-        }
-
-        QuadTreeAABB(T _Left, T _Top, T _Right, T _Bottom,
-            T _CenterX, T _CenterY, T _Width, T _Height) :
-            left(_Left),
-            top(_Top),
-            right(_Right),
-            bottom(_Bottom),
-            x(_CenterX),
-            y(_CenterY),
-            width(_Width),
-            height(_Height) {
-
-        }
 
-        QuadTreeAABB(T _Left, T _Top, T _Right, T _Bottom,
-            T _CenterX, T _CenterY) :
-            left(_Left),
-            top(_Top),
-            right(_Right),
-            bottom(_Bottom),
-            x(_CenterX),
-            y(_CenterY) {
-            set_dimensions();
-        }
+        QuadTreeAABB() : left(), top(), right(), bottom() {}
 
         QuadTreeAABB(T _Left, T _Top, T _Right, T _Bottom) :
             left(_Left),
             top(_Top),
             right(_Right),
-            bottom(_Bottom)
-        {
-            set_center();
-            set_dimensions();
+            bottom(_Bottom) {
         }
 
-        ~QuadTreeAABB() {}
+        T center_x() const { return (left + right) / (T)2; }
+        T center_y() const { return (top + bottom) / (T)2; }
 
-        void set_dimensions() {
-            width = bottom - top;
-            height = right - left;
-        }
-
-        void set_center() {
-            x = (left + right) / (T)2;
-            y = (top + bottom) / (T)2;
-        }
+        T width() const { return right - left; }
+        T height() const { return bottom - top; }
 
         bool verify() const {
             return ((left < right) && (top < bottom));
@@ -97,8 +108,276 @@ namespace nc {
             return ((_X > left) && (_X < right) 
                 && (_Y > top) && (_Y < bottom));
         }
+
+        // true if _Other lies completely inside, edges may touch
+        bool contains(const QuadTreeAABB<T>& _Other) const {
+            return (left <= _Other.left && right >= _Other.right &&
+                top <= _Other.top && bottom >= _Other.bottom);
+        }
+
+        bool operator==(const QuadTreeAABB<T>& _Other) const {
+            return (left == _Other.left && top == _Other.top &&
+                right == _Other.right && bottom == _Other.bottom);
+        }
+
+        bool operator!=(const QuadTreeAABB<T>& _Other) const {
+            return !(*this == _Other);
+        }
+    };
+
+    // structure-of-arrays storage for a fixed number of boxes, this is the
+    // layout the batch intersection kernels below operate on. the kernels
+    // use unaligned loads, so the arrays are not over-aligned: nodes live
+    // in a std::vector, which only guarantees the default alignment
+    // before C++17, and padding would grow small-capacity nodes
+    template <typename T, size_t _Count>
+    class QuadTreeAABBArray {
+    public:
+        std::array<T, _Count> left;
+        std::array<T, _Count> top;
+        std::array<T, _Count> right;
+        std::array<T, _Count> bottom;
+
+        QuadTreeAABB<T> get(size_t _Index) const {
+            return QuadTreeAABB<T>(left[_Index], top[_Index],
+                right[_Index], bottom[_Index]);
+        }
+
+        void set(size_t _Index, const QuadTreeAABB<T>& _Bounds) {
+            left[_Index] = _Bounds.left;
+            top[_Index] = _Bounds.top;
+            right[_Index] = _Bounds.right;
+            bottom[_Index] = _Bounds.bottom;
+        }
+
+        void copy(size_t _To, size_t _From) {
+            left[_To] = left[_From];
+            top[_To] = top[_From];
+            right[_To] = right[_From];
+            bottom[_To] = bottom[_From];
+        }
     };
 
+    namespace simd {
+        // scalar kernel, also handles the tail the vector kernels leave over
+        template <typename T>
+        inline size_t query_batch(const QuadTreeAABB<T>& _Bounds,
+            const T* _Left, const T* _Top, const T* _Right, const T* _Bottom,
+            size_t _Count, uint32_t* _Indices, size_t _Begin = 0, size_t _Length = 0)
+        {
+            for (size_t i = _Begin; i < _Count; i++) {
+                // branchless, the slot is overwritten when the test fails
+                _Indices[_Length] = static_cast<uint32_t>(i);
+                _Length += (_Left[i] < _Bounds.right) & (_Right[i] > _Bounds.left) &
+                    (_Top[i] < _Bounds.bottom) & (_Bottom[i] > _Bounds.top);
+            }
+
+            return _Length;
+        }
+
+        // appends the lanes set in _Mask, starting at index _Base
+        inline size_t emit_mask(unsigned _Mask, size_t _Lanes, size_t _Base,
+            uint32_t* _Indices, size_t _Length)
+        {
+            for (size_t k = 0; k < _Lanes; k++) {
+                _Indices[_Length] = static_cast<uint32_t>(_Base + k);
+                _Length += (_Mask >> k) & 1u;
+            }
+
+            return _Length;
+        }
+
+#if defined(NC_QUADTREE_SIMD_AVX2)
+        inline size_t query_batch(const QuadTreeAABB<float>& _Bounds,
+            const float* _Left, const float* _Top, const float* _Right, const float* _Bottom,
+            size_t _Count, uint32_t* _Indices)
+        {
+            const __m256 ql = _mm256_set1_ps(_Bounds.left), qt = _mm256_set1_ps(_Bounds.top);
+            const __m256 qr = _mm256_set1_ps(_Bounds.right), qb = _mm256_set1_ps(_Bounds.bottom);
+            size_t i = 0, length = 0;
+
+            for (; i + 8 <= _Count; i += 8) {
+                __m256 m = _mm256_and_ps(
+                    _mm256_and_ps(_mm256_cmp_ps(_mm256_loadu_ps(_Left + i), qr, _CMP_LT_OQ),
+                        _mm256_cmp_ps(_mm256_loadu_ps(_Right + i), ql, _CMP_GT_OQ)),
+                    _mm256_and_ps(_mm256_cmp_ps(_mm256_loadu_ps(_Top + i), qb, _CMP_LT_OQ),
+                        _mm256_cmp_ps(_mm256_loadu_ps(_Bottom + i), qt, _CMP_GT_OQ)));
+                length = emit_mask(static_cast<unsigned>(_mm256_movemask_ps(m)), 8, i, _Indices, length);
+            }
+
+            return query_batch<float>(_Bounds, _Left, _Top, _Right, _Bottom, _Count, _Indices, i, length);
+        }
+
+        inline size_t query_batch(const QuadTreeAABB<double>& _Bounds,
+            const double* _Left, const double* _Top, const double* _Right, const double* _Bottom,
+            size_t _Count, uint32_t* _Indices)
+        {
+            const __m256d ql = _mm256_set1_pd(_Bounds.left), qt = _mm256_set1_pd(_Bounds.top);
+            const __m256d qr = _mm256_set1_pd(_Bounds.right), qb = _mm256_set1_pd(_Bounds.bottom);
+            size_t i = 0, length = 0;
+
+            for (; i + 4 <= _Count; i += 4) {
+                __m256d m = _mm256_and_pd(
+                    _mm256_and_pd(_mm256_cmp_pd(_mm256_loadu_pd(_Left + i), qr, _CMP_LT_OQ),
+                        _mm256_cmp_pd(_mm256_loadu_pd(_Right + i), ql, _CMP_GT_OQ)),
+                    _mm256_and_pd(_mm256_cmp_pd(_mm256_loadu_pd(_Top + i), qb, _CMP_LT_OQ),
+                        _mm256_cmp_pd(_mm256_loadu_pd(_Bottom + i), qt, _CMP_GT_OQ)));
+                length = emit_mask(static_cast<unsigned>(_mm256_movemask_pd(m)), 4, i, _Indices, length);
+            }
+
+            return query_batch<double>(_Bounds, _Left, _Top, _Right, _Bottom, _Count, _Indices, i, length);
+        }
+
+        inline size_t query_batch(const QuadTreeAABB<int32_t>& _Bounds,
+            const int32_t* _Left, const int32_t* _Top, const int32_t* _Right, const int32_t* _Bottom,
+            size_t _Count, uint32_t* _Indices)
+        {
+            const __m256i ql = _mm256_set1_epi32(_Bounds.left), qt = _mm256_set1_epi32(_Bounds.top);
+            const __m256i qr = _mm256_set1_epi32(_Bounds.right), qb = _mm256_set1_epi32(_Bounds.bottom);
+            size_t i = 0, length = 0;
+
+            for (; i + 8 <= _Count; i += 8) {
+                __m256i m = _mm256_and_si256(
+                    _mm256_and_si256(
+                        _mm256_cmpgt_epi32(qr, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(_Left + i))),
+                        _mm256_cmpgt_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(_Right + i)), ql)),
+                    _mm256_and_si256(
+                        _mm256_cmpgt_epi32(qb, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(_Top + i))),
+                        _mm256_cmpgt_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(_Bottom + i)), qt)));
+                length = emit_mask(static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(m))),
+                    8, i, _Indices, length);
+            }
+
+            return query_batch<int32_t>(_Bounds, _Left, _Top, _Right, _Bottom, _Count, _Indices, i, length);
+        }
+#elif defined(NC_QUADTREE_SIMD_SSE2)
+        inline size_t query_batch(const QuadTreeAABB<float>& _Bounds,
+            const float* _Left, const float* _Top, const float* _Right, const float* _Bottom,
+            size_t _Count, uint32_t* _Indices)
+        {
+            const __m128 ql = _mm_set1_ps(_Bounds.left), qt = _mm_set1_ps(_Bounds.top);
+            const __m128 qr = _mm_set1_ps(_Bounds.right), qb = _mm_set1_ps(_Bounds.bottom);
+            size_t i = 0, length = 0;
+
+            for (; i + 4 <= _Count; i += 4) {
+                __m128 m = _mm_and_ps(
+                    _mm_and_ps(_mm_cmplt_ps(_mm_loadu_ps(_Left + i), qr),
+                        _mm_cmpgt_ps(_mm_loadu_ps(_Right + i), ql)),
+                    _mm_and_ps(_mm_cmplt_ps(_mm_loadu_ps(_Top + i), qb),
+                        _mm_cmpgt_ps(_mm_loadu_ps(_Bottom + i), qt)));
+                length = emit_mask(static_cast<unsigned>(_mm_movemask_ps(m)), 4, i, _Indices, length);
+            }
+
+            return query_batch<float>(_Bounds, _Left, _Top, _Right, _Bottom, _Count, _Indices, i, length);
+        }
+
+        inline size_t query_batch(const QuadTreeAABB<double>& _Bounds,
+            const double* _Left, const double* _Top, const double* _Right, const double* _Bottom,
+            size_t _Count, uint32_t* _Indices)
+        {
+            const __m128d ql = _mm_set1_pd(_Bounds.left), qt = _mm_set1_pd(_Bounds.top);
+            const __m128d qr = _mm_set1_pd(_Bounds.right), qb = _mm_set1_pd(_Bounds.bottom);
+            size_t i = 0, length = 0;
+
+            for (; i + 2 <= _Count; i += 2) {
+                __m128d m = _mm_and_pd(
+                    _mm_and_pd(_mm_cmplt_pd(_mm_loadu_pd(_Left + i), qr),
+                        _mm_cmpgt_pd(_mm_loadu_pd(_Right + i), ql)),
+                    _mm_and_pd(_mm_cmplt_pd(_mm_loadu_pd(_Top + i), qb),
+                        _mm_cmpgt_pd(_mm_loadu_pd(_Bottom + i), qt)));
+                length = emit_mask(static_cast<unsigned>(_mm_movemask_pd(m)), 2, i, _Indices, length);
+            }
+
+            return query_batch<double>(_Bounds, _Left, _Top, _Right, _Bottom, _Count, _Indices, i, length);
+        }
+
+        inline size_t query_batch(const QuadTreeAABB<int32_t>& _Bounds,
+            const int32_t* _Left, const int32_t* _Top, const int32_t* _Right, const int32_t* _Bottom,
+            size_t _Count, uint32_t* _Indices)
+        {
+            const __m128i ql = _mm_set1_epi32(_Bounds.left), qt = _mm_set1_epi32(_Bounds.top);
+            const __m128i qr = _mm_set1_epi32(_Bounds.right), qb = _mm_set1_epi32(_Bounds.bottom);
+            size_t i = 0, length = 0;
+
+            for (; i + 4 <= _Count; i += 4) {
+                __m128i m = _mm_and_si128(
+                    _mm_and_si128(
+                        _mm_cmplt_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(_Left + i)), qr),
+                        _mm_cmpgt_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(_Right + i)), ql)),
+                    _mm_and_si128(
+                        _mm_cmplt_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(_Top + i)), qb),
+                        _mm_cmpgt_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(_Bottom + i)), qt)));
+                length = emit_mask(static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(m))),
+                    4, i, _Indices, length);
+            }
+
+            return query_batch<int32_t>(_Bounds, _Left, _Top, _Right, _Bottom, _Count, _Indices, i, length);
+        }
+#elif defined(NC_QUADTREE_SIMD_NEON)
+        // folds a 4 lane comparison result into a bit mask
+        inline unsigned movemask(uint32x4_t _Mask)
+        {
+            return (vgetq_lane_u32(_Mask, 0) & 1u) | (vgetq_lane_u32(_Mask, 1) & 2u) |
+                (vgetq_lane_u32(_Mask, 2) & 4u) | (vgetq_lane_u32(_Mask, 3) & 8u);
+        }
+
+        inline size_t query_batch(const QuadTreeAABB<float>& _Bounds,
+            const float* _Left, const float* _Top, const float* _Right, const float* _Bottom,
+            size_t _Count, uint32_t* _Indices)
+        {
+            const float32x4_t ql = vdupq_n_f32(_Bounds.left), qt = vdupq_n_f32(_Bounds.top);
+            const float32x4_t qr = vdupq_n_f32(_Bounds.right), qb = vdupq_n_f32(_Bounds.bottom);
+            size_t i = 0, length = 0;
+
+            for (; i + 4 <= _Count; i += 4) {
+                uint32x4_t m = vandq_u32(
+                    vandq_u32(vcltq_f32(vld1q_f32(_Left + i), qr), vcgtq_f32(vld1q_f32(_Right + i), ql)),
+                    vandq_u32(vcltq_f32(vld1q_f32(_Top + i), qb), vcgtq_f32(vld1q_f32(_Bottom + i), qt)));
+                length = emit_mask(movemask(m), 4, i, _Indices, length);
+            }
+
+            return query_batch<float>(_Bounds, _Left, _Top, _Right, _Bottom, _Count, _Indices, i, length);
+        }
+
+        inline size_t query_batch(const QuadTreeAABB<int32_t>& _Bounds,
+            const int32_t* _Left, const int32_t* _Top, const int32_t* _Right, const int32_t* _Bottom,
+            size_t _Count, uint32_t* _Indices)
+        {
+            const int32x4_t ql = vdupq_n_s32(_Bounds.left), qt = vdupq_n_s32(_Bounds.top);
+            const int32x4_t qr = vdupq_n_s32(_Bounds.right), qb = vdupq_n_s32(_Bounds.bottom);
+            size_t i = 0, length = 0;
+
+            for (; i + 4 <= _Count; i += 4) {
+                uint32x4_t m = vandq_u32(
+                    vandq_u32(vcltq_s32(vld1q_s32(_Left + i), qr), vcgtq_s32(vld1q_s32(_Right + i), ql)),
+                    vandq_u32(vcltq_s32(vld1q_s32(_Top + i), qb), vcgtq_s32(vld1q_s32(_Bottom + i), qt)));
+                length = emit_mask(movemask(m), 4, i, _Indices, length);
+            }
+
+            return query_batch<int32_t>(_Bounds, _Left, _Top, _Right, _Bottom, _Count, _Indices, i, length);
+        }
+#endif
+    } // namespace simd
+
+    // tests _Bounds against _Count boxes stored as separate edge arrays and
+    // writes the indices of the intersecting ones to _Indices, which must
+    // have room for _Count entries. returns the number of hits
+    template <typename T>
+    inline size_t query_batch(const QuadTreeAABB<T>& _Bounds,
+        const T* _Left, const T* _Top, const T* _Right, const T* _Bottom,
+        size_t _Count, uint32_t* _Indices)
+    {
+        return simd::query_batch(_Bounds, _Left, _Top, _Right, _Bottom, _Count, _Indices);
+    }
+
+    template <typename T, size_t _Capacity>
+    inline size_t query_batch(const QuadTreeAABB<T>& _Bounds,
+        const QuadTreeAABBArray<T, _Capacity>& _Boxes, size_t _Count, uint32_t* _Indices)
+    {
+        return simd::query_batch(_Bounds, _Boxes.left.data(), _Boxes.top.data(),
+            _Boxes.right.data(), _Boxes.bottom.data(), _Count, _Indices);
+    }
+
     template <typename T>
     class QuadTreeObject {
     public:
@@ -114,330 +393,3905 @@ namespace nc {
         size_t id;
     };
 
-    template <typename T = double, size_t _Capacity = 2>
-    class QuadTree 
-        : public std::enable_shared_from_this<QuadTree<T,_Capacity>> {
-    private:
-        static constexpr size_t kChildren = 4;
-
-        QuadTreeAABB<T> bounds;
-        QuadTreeAABB<T> max_bounds;
+    // scalar used for distances and shape math, double for integer trees
+    template <typename T>
+    using QuadTreeScalar = typename std::conditional<std::is_floating_point<T>::value, T, double>::type;
 
-        size_t object_count = 0;
-        std::vector<std::shared_ptr<QuadTreeObject<T>>> objects;
-        std::vector<std::shared_ptr<QuadTree<T,_Capacity>>> children;
-        std::shared_ptr<QuadTree<T, _Capacity>> root;
+    // box covering [_Left, _Right] x [_Top, _Bottom], rounded outwards
+    // for integer coordinates
+    template <typename T>
+    inline QuadTreeAABB<T> make_covering_aabb(QuadTreeScalar<T> _Left, QuadTreeScalar<T> _Top,
+        QuadTreeScalar<T> _Right, QuadTreeScalar<T> _Bottom)
+    {
+        if (std::is_floating_point<T>::value) {
+            return QuadTreeAABB<T>(static_cast<T>(_Left), static_cast<T>(_Top),
+                static_cast<T>(_Right), static_cast<T>(_Bottom));
+        }
 
-        bool has_children = false;
+        return QuadTreeAABB<T>(static_cast<T>(std::floor(_Left)), static_cast<T>(std::floor(_Top)),
+            static_cast<T>(std::ceil(_Right)), static_cast<T>(std::ceil(_Bottom)));
+    }
 
-        void split();
-        void merge();
+    // query shapes. a shape provides get_bounds(), an axis aligned box
+    // containing it that is used to prefilter leaf slots, and
+    // intersects(box), an exact overlap test that rejects nodes by their
+    // max_bounds and decides which objects are hits. QuadTreeAABB itself
+    // is queried through the dedicated overloads
+    template <typename T>
+    class QuadTreeCircle {
+    public:
+        using Scalar = QuadTreeScalar<T>;
 
-        void remove_empty_nodes();
+        Scalar x, y;
+        Scalar radius;
 
-        size_t level = 1;
-    public:
-        QuadTree() {
-            level = 1;
+        QuadTreeCircle() {}
+        QuadTreeCircle(Scalar _X, Scalar _Y, Scalar _Radius)
+            : x(_X), y(_Y), radius(_Radius) {}
+        ~QuadTreeCircle() {}
 
-            objects.resize(_Capacity);
-            has_children = false;
-            for (size_t i = 0; i < _Capacity; i++)
-                objects[i].reset();
+        QuadTreeAABB<T> get_bounds() const {
+            return make_covering_aabb<T>(x - radius, y - radius, x + radius, y + radius);
         }
 
-        QuadTree(const QuadTreeAABB<T>& _Bounds) : bounds(_Bounds), max_bounds(_Bounds) {
-            level = 1;
+        bool intersects(const QuadTreeAABB<T>& _Bounds) const {
+            Scalar dx = std::max(std::max(static_cast<Scalar>(_Bounds.left) - x, Scalar(0)),
+                x - static_cast<Scalar>(_Bounds.right));
+            Scalar dy = std::max(std::max(static_cast<Scalar>(_Bounds.top) - y, Scalar(0)),
+                y - static_cast<Scalar>(_Bounds.bottom));
 
-            objects.resize(_Capacity);
-            has_children = false;
-            for (size_t i = 0; i < _Capacity; i++)
-                objects[i].reset();
+            return dx * dx + dy * dy < radius * radius;
         }
+    };
 
-        ~QuadTree() {
+    template <typename T>
+    class QuadTreeOrientedBox {
+    public:
+        using Scalar = QuadTreeScalar<T>;
+
+        // center, half extents along the box axes and rotation in radians
+        QuadTreeOrientedBox() {}
+        QuadTreeOrientedBox(Scalar _X, Scalar _Y, Scalar _HalfWidth, Scalar _HalfHeight, Scalar _Angle)
+            : x(_X), y(_Y), half_width(_HalfWidth), half_height(_HalfHeight),
+            cos_angle(std::cos(_Angle)), sin_angle(std::sin(_Angle)) {}
+        ~QuadTreeOrientedBox() {}
+
+        QuadTreeAABB<T> get_bounds() const {
+            Scalar ex = std::abs(cos_angle) * half_width + std::abs(sin_angle) * half_height;
+            Scalar ey = std::abs(sin_angle) * half_width + std::abs(cos_angle) * half_height;
+
+            return make_covering_aabb<T>(x - ex, y - ey, x + ex, y + ey);
         }
 
-        void set_bounds(const QuadTreeAABB<T>& _Bounds) {
-            bounds = _Bounds;
-            max_bounds = _Bounds;
+        // separating axis test on the two world axes and the two box axes
+        bool intersects(const QuadTreeAABB<T>& _Bounds) const {
+            Scalar bx = (static_cast<Scalar>(_Bounds.left) + static_cast<Scalar>(_Bounds.right)) / 2;
+            Scalar by = (static_cast<Scalar>(_Bounds.top) + static_cast<Scalar>(_Bounds.bottom)) / 2;
+            Scalar bw = (static_cast<Scalar>(_Bounds.right) - static_cast<Scalar>(_Bounds.left)) / 2;
+            Scalar bh = (static_cast<Scalar>(_Bounds.bottom) - static_cast<Scalar>(_Bounds.top)) / 2;
+            Scalar dx = x - bx;
+            Scalar dy = y - by;
+
+            Scalar ex = std::abs(cos_angle) * half_width + std::abs(sin_angle) * half_height;
+            Scalar ey = std::abs(sin_angle) * half_width + std::abs(cos_angle) * half_height;
+
+            if (std::abs(dx) >= bw + ex || std::abs(dy) >= bh + ey)
+                return false;
+
+            Scalar eu = std::abs(cos_angle) * bw + std::abs(sin_angle) * bh;
+            Scalar ev = std::abs(sin_angle) * bw + std::abs(cos_angle) * bh;
+
+            return std::abs(dx * cos_angle + dy * sin_angle) < half_width + eu &&
+                std::abs(dy * cos_angle - dx * sin_angle) < half_height + ev;
         }
+    private:
+        Scalar x, y;
+        Scalar half_width, half_height;
+        Scalar cos_angle, sin_angle;
+    };
 
-        void resolve_max_bounds();
+    template <typename T>
+    class QuadTreeConvexPolygon {
+    public:
+        using Scalar = QuadTreeScalar<T>;
 
-        const QuadTreeAABB<T>& get_bounds() const {
-            return bounds;
+        struct Vertex {
+            Scalar x, y;
+        };
+
+        // _Vertices must describe a convex polygon, in either winding
+        QuadTreeConvexPolygon() {}
+        QuadTreeConvexPolygon(const std::vector<Vertex>& _Vertices) {
+            set_vertices(_Vertices);
         }
+        ~QuadTreeConvexPolygon() {}
 
-        const QuadTreeAABB<T>& get_max_bounds() const {
-            return max_bounds;
+        void set_vertices(const std::vector<Vertex>& _Vertices) {
+            vertices = _Vertices;
+            axes.clear();
+
+            // an empty polygon has empty bounds at the origin
+            if (vertices.empty()) {
+                bounds_min = bounds_max = Vertex();
+                return;
+            }
+
+            bounds_min = bounds_max = vertices[0];
+
+            for (const Vertex& vertex : vertices) {
+                bounds_min.x = std::min(bounds_min.x, vertex.x);
+                bounds_min.y = std::min(bounds_min.y, vertex.y);
+                bounds_max.x = std::max(bounds_max.x, vertex.x);
+                bounds_max.y = std::max(bounds_max.y, vertex.y);
+            }
+
+            // edge normals with the polygon projected on each of them
+            for (size_t i = 0; i < vertices.size(); i++) {
+                const Vertex& a = vertices[i];
+                const Vertex& b = vertices[(i + 1) % vertices.size()];
+                Axis axis;
+
+                axis.x = a.y - b.y;
+                axis.y = b.x - a.x;
+                axis.min = axis.max = axis.x * a.x + axis.y * a.y;
+
+                for (const Vertex& vertex : vertices) {
+                    Scalar d = axis.x * vertex.x + axis.y * vertex.y;
+
+                    axis.min = std::min(axis.min, d);
+                    axis.max = std::max(axis.max, d);
+                }
+
+                axes.push_back(axis);
+            }
         }
 
-        bool insert(const std::shared_ptr<QuadTreeObject<T>>& _Object);
-        bool remove(const std::shared_ptr<QuadTreeObject<T>>& _Object);
+        const std::vector<Vertex>& get_vertices() const { return vertices; }
 
-        void query(const QuadTreeAABB<T>& _Boundaries,
-            std::shared_ptr<QuadTreeObject<T>>* _Objects, size_t& _Length,
-            bool _BoundChecks = true) const;
-        void query(const QuadTreeAABB<T>& _Boundaries,
-            std::vector<std::shared_ptr<QuadTreeObject<T>>>& _Objects,
-            bool _BoundChecks = true) const;
+        QuadTreeAABB<T> get_bounds() const {
+            return make_covering_aabb<T>(bounds_min.x, bounds_min.y, bounds_max.x, bounds_max.y);
+        }
 
-        bool has_children_() const { return has_children; }
+        // separating axis test on the world axes and every edge normal
+        bool intersects(const QuadTreeAABB<T>& _Bounds) const {
+            if (vertices.empty())
+                return false;
 
-        const std::vector<std::shared_ptr<QuadTree<T, _Capacity>>>& get_children() const { return children; }
+            if (bounds_min.x >= static_cast<Scalar>(_Bounds.right) ||
+                bounds_max.x <= static_cast<Scalar>(_Bounds.left) ||
+                bounds_min.y >= static_cast<Scalar>(_Bounds.bottom) ||
+                bounds_max.y <= static_cast<Scalar>(_Bounds.top))
+                return false;
 
-        size_t get_total_objects() const;
-    };
+            Scalar bx = (static_cast<Scalar>(_Bounds.left) + static_cast<Scalar>(_Bounds.right)) / 2;
+            Scalar by = (static_cast<Scalar>(_Bounds.top) + static_cast<Scalar>(_Bounds.bottom)) / 2;
+            Scalar bw = (static_cast<Scalar>(_Bounds.right) - static_cast<Scalar>(_Bounds.left)) / 2;
+            Scalar bh = (static_cast<Scalar>(_Bounds.bottom) - static_cast<Scalar>(_Bounds.top)) / 2;
 
-    template<typename T, size_t _Capacity>
-    inline void QuadTree<T, _Capacity>::split()
-    {
-        if (!has_children) {
-            QuadTreeAABB<T> child_aabb;
+            for (const Axis& axis : axes) {
+                Scalar center = axis.x * bx + axis.y * by;
+                Scalar extent = std::abs(axis.x) * bw + std::abs(axis.y) * bh;
 
-            children.resize(kChildren);
-            // top left
-            child_aabb.left = bounds.left;
-            child_aabb.top = bounds.top;
-            child_aabb.right = bounds.x;
-            child_aabb.bottom = bounds.y;
-            child_aabb.set_center();
-            child_aabb.set_dimensions();
-            children[0] = std::make_shared<QuadTree<T, _Capacity>>(child_aabb);
-            children[0]->level = level + 1;
-            children[0]->root = shared_from_this();
-            // top right
-            child_aabb.left = bounds.x;
-            child_aabb.top = bounds.top;
-            child_aabb.right = bounds.right;
-            child_aabb.bottom = bounds.y;
-            child_aabb.set_center();
-            child_aabb.set_dimensions();
-            children[1] = std::make_shared<QuadTree<T, _Capacity>>(child_aabb);
-            children[1]->set_bounds(child_aabb);
-            children[1]->level = level + 1;
-            children[1]->root = shared_from_this();
-            // bottom right
-            child_aabb.left = bounds.x;
-            child_aabb.top = bounds.y;
-            child_aabb.right = bounds.right;
-            child_aabb.bottom = bounds.bottom;
-            child_aabb.set_center();
-            child_aabb.set_dimensions();
-            children[2] = std::make_shared<QuadTree<T, _Capacity>>(child_aabb);
-            children[2]->set_bounds(child_aabb);
-            children[2]->level = level + 1;
-            children[2]->root = shared_from_this();
-            // bottom left
-            child_aabb.left = bounds.left;
-            child_aabb.top = bounds.y;
-            child_aabb.right = bounds.x;
-            child_aabb.bottom = bounds.bottom;
-            child_aabb.set_center();
-            child_aabb.set_dimensions();
-            children[3] = std::make_shared<QuadTree<T, _Capacity>>(child_aabb);
-            children[3]->set_bounds(child_aabb);
-            children[3]->level = level + 1;
-            children[3]->root = shared_from_this();
+                if (center - extent >= axis.max || center + extent <= axis.min)
+                    return false;
+            }
 
-            has_children = true;
+            return true;
         }
+    private:
+        struct Axis {
+            Scalar x, y;
+            Scalar min, max;
+        };
+
+        std::vector<Vertex> vertices;
+        std::vector<Axis> axes;
+        Vertex bounds_min = {}, bounds_max = {};
+    };
+
+    // calls a query visitor, visitors may return void or a bool where
+    // false stops the traversal
+    template <typename _Visitor, typename... _Arguments>
+    inline bool call_visitor(std::true_type, _Visitor& _Func, _Arguments&&... _Args)
+    {
+        _Func(std::forward<_Arguments>(_Args)...);
+        return true;
     }
 
-    template<typename T, size_t _Capacity>
-    inline void QuadTree<T, _Capacity>::merge()
+    template <typename _Visitor, typename... _Arguments>
+    inline bool call_visitor(std::false_type, _Visitor& _Func, _Arguments&&... _Args)
     {
-        if (has_children) {
-            children[0]->merge();
-            children[1]->merge();
-            children[2]->merge();
-            children[3]->merge();
+        return static_cast<bool>(_Func(std::forward<_Arguments>(_Args)...));
+    }
 
-            children.clear();
+    template <typename _Visitor, typename... _Arguments>
+    inline bool call_visitor(_Visitor& _Func, _Arguments&&... _Args)
+    {
+        using Result = decltype(_Func(std::forward<_Arguments>(_Args)...));
 
-            has_children = false;
-        }
+        return call_visitor(std::is_void<Result>(), _Func, std::forward<_Arguments>(_Args)...);
     }
 
-    template<typename T, size_t _Capacity>
-    inline void QuadTree<T, _Capacity>::remove_empty_nodes()
-    {
-        if (has_children) {
-            children[0]->remove_empty_nodes();
-            children[1]->remove_empty_nodes();
-            children[2]->remove_empty_nodes();
-            children[3]->remove_empty_nodes();
+    namespace morton {
+        // spreads the bits of _Value so there is a zero bit between each
+        inline uint64_t spread(uint32_t _Value)
+        {
+            uint64_t x = _Value;
 
-            if (get_total_objects() < 1)
-                merge();
+            x = (x | (x << 16)) & 0x0000FFFF0000FFFFull;
+            x = (x | (x << 8)) & 0x00FF00FF00FF00FFull;
+            x = (x | (x << 4)) & 0x0F0F0F0F0F0F0F0Full;
+            x = (x | (x << 2)) & 0x3333333333333333ull;
+            x = (x | (x << 1)) & 0x5555555555555555ull;
+
+            return x;
         }
-    }
 
-    template<typename T, size_t _Capacity>
-    inline void QuadTree<T, _Capacity>::resolve_max_bounds()
-    {
-        max_bounds = bounds; 
+        // z-order key, x takes the even bits and y the odd bits
+        inline uint64_t encode(uint32_t _X, uint32_t _Y)
+        {
+            return spread(_X) | (spread(_Y) << 1);
+        }
 
-        for (size_t i = 0; i < _Capacity; i++) {
-            if (objects[i]) {
-                max_bounds.left = std::min(max_bounds.left, objects[i]->bounds.left);
-                max_bounds.top = std::min(max_bounds.top, objects[i]->bounds.top);
-                max_bounds.right = std::max(max_bounds.right, objects[i]->bounds.right);
-                max_bounds.bottom = std::max(max_bounds.bottom, objects[i]->bounds.bottom);
+        // maps _Value from [_Min, _Max] onto the full 32-bit range
+        template <typename T>
+        inline uint32_t quantize(T _Value, T _Min, T _Max)
+        {
+            double range = static_cast<double>(_Max) - static_cast<double>(_Min);
+            double t = range > 0.0
+                ? (static_cast<double>(_Value) - static_cast<double>(_Min)) / range : 0.0;
 
-                if (!max_bounds.verify()) {
-                    throw std::exception("invalid bounds");
-                }
-            }
+            if (!(t > 0.0))
+                return 0;
+            if (t >= 1.0)
+                return 0xFFFFFFFFu;
+
+            return static_cast<uint32_t>(t * 4294967296.0);
         }
 
-        if (has_children) {
-            for (size_t i = 0; i < kChildren; i++) {
-                max_bounds.left = std::min(max_bounds.left, children[i]->max_bounds.left);
-                max_bounds.top = std::min(max_bounds.top, children[i]->max_bounds.top);
-                max_bounds.right = std::max(max_bounds.right, children[i]->max_bounds.right);
-                max_bounds.bottom = std::max(max_bounds.bottom, children[i]->max_bounds.bottom);
+        // key of the center of _Bounds inside _Space
+        template <typename T>
+        inline uint64_t encode(const QuadTreeAABB<T>& _Space, const QuadTreeAABB<T>& _Bounds)
+        {
+            T x = _Bounds.left + (_Bounds.right - _Bounds.left) / (T)2;
+            T y = _Bounds.top + (_Bounds.bottom - _Bounds.top) / (T)2;
 
-                if (!max_bounds.verify()) {
-                    throw std::exception("invalid bounds");
-                }
-            }
+            return encode(quantize(x, _Space.left, _Space.right),
+                quantize(y, _Space.top, _Space.bottom));
         }
+    } // namespace morton
 
-        max_bounds.set_center();
-        max_bounds.set_dimensions();
-        
-        if (root)
-            root->resolve_max_bounds();
-    }
+    // fixed-size pool of tree nodes addressed by 32-bit indices.
+    // children are always allocated as a block of kBlockSize contiguous
+    // nodes so a parent only has to store the index of its first child,
+    // freed blocks are recycled instead of being returned to the allocator.
+    // nodes are stored in pages that copies of the pool share, a page is
+    // cloned the first time a shared node is written through operator[].
+    // growing never moves nodes, references stay valid until the pool is
+    // cleared or one of its pages is cloned
+    template <typename _Node>
+    class QuadTreeNodePool {
+    public:
+        using Index = uint32_t;
 
-    template<typename T, size_t _Capacity>
-    inline bool QuadTree<T, _Capacity>::insert(const std::shared_ptr<QuadTreeObject<T>>& _Object)
-    {
-        if (bounds.intersects(_Object->bounds)) {
-            if (object_count >= _Capacity) {
-                if (!has_children)
-                    split();
+        static constexpr Index kNull = ~Index(0);
+        static constexpr size_t kBlockSize = 4;
+        static constexpr size_t kPageShift = 6;
+        static constexpr size_t kPageSize = size_t(1) << kPageShift;
+
+        QuadTreeNodePool() {}
+        ~QuadTreeNodePool() {}
+
+        // copies share every page, neither side owns them afterwards.
+        // several threads may copy the same pool as long as none writes it
+        QuadTreeNodePool(const QuadTreeNodePool& _Other)
+            : pages(_Other.pages), free_blocks(_Other.free_blocks), count(_Other.count) {
+            _Other.release();
+        }
 
-                if (!children[0]->insert(_Object) 
-                    && !children[1]->insert(_Object)
-                    && !children[2]->insert(_Object)
-                    && !children[3]->insert(_Object))
-                    throw std::out_of_range("object position out of range");
+        QuadTreeNodePool(QuadTreeNodePool&&) = default;
 
-                return true;
+        QuadTreeNodePool& operator=(const QuadTreeNodePool& _Other) {
+            if (this != &_Other) {
+                pages = _Other.pages;
+                free_blocks = _Other.free_blocks;
+                count = _Other.count;
+                _Other.release();
             }
-            else {
-                for (size_t i = 0; i < _Capacity; i++) {
-                    if (!objects[i]) {
-                        objects[i] = _Object;
 
-                        object_count++;
+            return *this;
+        }
 
-                        resolve_max_bounds();
-                        return true;
-                    }
-                }
+        QuadTreeNodePool& operator=(QuadTreeNodePool&&) = default;
+
+        // allocates a single node, only used for the root
+        Index allocate() {
+            return extend(1);
+        }
+
+        Index allocate_block() {
+            if (!free_blocks.empty()) {
+                Index block = free_blocks.back();
+                free_blocks.pop_back();
+                return block;
             }
+
+            return extend(kBlockSize);
         }
 
-        return false;
-    }
+        // appends _Count nodes that are not part of any block and returns
+        // the index of the first one, used to splice in other pools
+        Index extend(size_t _Count) {
+            if (count + _Count >= kNull)
+                throw std::length_error("node pool exhausted");
 
-    template<typename T, size_t _Capacity>
-    inline bool QuadTree<T, _Capacity>::remove(const std::shared_ptr<QuadTreeObject<T>>& _Object)
-    {
-        if (bounds.intersects(_Object->bounds)) {
-            if (object_count > 0) {
-                for (size_t i = 0; i < _Capacity; i++) {
-                    if (objects[i] && objects[i]->id == _Object->id) {
-                        objects[i].reset();
-                        object_count--;
-                        remove_empty_nodes();
+            Index first = static_cast<Index>(count);
+            count += _Count;
 
-                        resolve_max_bounds();
+            // slots past count are never written, new pages start owned
+            while (pages.size() * kPageSize < count)
+                pages.emplace_back(std::make_shared<Page>());
 
-                        return true;
-                    }
-                }
-            }
-            
-            if (has_children) {
-                if (!children[0]->remove(_Object)
-                    && !children[1]->remove(_Object)
-                    && !children[2]->remove(_Object)
-                    && !children[3]->remove(_Object))
-                    return false;
+            return first;
+        }
 
-                return true;
+        void free_block(Index _Block) {
+            for (size_t i = 0; i < kBlockSize; i++)
+                (*this)[_Block + i] = _Node();
+
+            free_blocks.push_back(_Block);
+        }
+
+        // reserves storage for at least _Count nodes
+        void reserve(size_t _Count) {
+            pages.reserve((_Count + kPageSize - 1) / kPageSize);
+        }
+
+        void clear() {
+            pages.clear();
+            free_blocks.clear();
+            count = 0;
+        }
+
+        _Node& operator[](Index _Index) {
+            PageRef& ref = pages[_Index >> kPageShift];
+
+            if (!ref.owned.load(std::memory_order_relaxed)) {
+                ref.page = std::make_shared<Page>(*ref.page);
+                ref.owned.store(true, std::memory_order_relaxed);
             }
 
+            return ref.page->nodes[_Index & (kPageSize - 1)];
         }
-        else {
-            return false;
+
+        const _Node& operator[](Index _Index) const {
+            return pages[_Index >> kPageShift].page->nodes[_Index & (kPageSize - 1)];
         }
-    }
 
-    template<typename T, size_t _Capacity>
-    inline void QuadTree<T, _Capacity>::query(const QuadTreeAABB<T>& _Bounds, 
-        std::shared_ptr<QuadTreeObject<T>>* _Objects, size_t& _Length, bool _BoundChecks) const
-    {
-        if (max_bounds.intersects(_Bounds) || !_BoundChecks) {
-            if (has_children) {
-                children[0]->query(_Bounds, _Objects, _Length, _BoundChecks);
-                children[1]->query(_Bounds, _Objects, _Length, _BoundChecks);
-                children[2]->query(_Bounds, _Objects, _Length, _BoundChecks);
-                children[3]->query(_Bounds, _Objects, _Length, _BoundChecks);
+        // number of node slots, including the ones on the free list
+        size_t size() const { return count; }
+        size_t free_size() const { return free_blocks.size() * kBlockSize; }
+    private:
+        struct Page {
+            std::array<_Node, kPageSize> nodes;
+        };
+
+        // owned is only cleared by copies of the pool, which may run on
+        // several threads at once
+        struct PageRef {
+            std::shared_ptr<Page> page;
+            mutable std::atomic<bool> owned;
+
+            PageRef(std::shared_ptr<Page> _Page) : page(std::move(_Page)), owned(true) {}
+            PageRef(const PageRef& _Other) : page(_Other.page), owned(false) {}
+            PageRef(PageRef&& _Other) noexcept
+                : page(std::move(_Other.page)), owned(_Other.owned.load(std::memory_order_relaxed)) {}
+
+            PageRef& operator=(const PageRef& _Other) {
+                page = _Other.page;
+                owned.store(false, std::memory_order_relaxed);
+                return *this;
             }
 
-            if (object_count < 1)
-                return;
+            PageRef& operator=(PageRef&& _Other) noexcept {
+                page = std::move(_Other.page);
+                owned.store(_Other.owned.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                return *this;
+            }
+        };
 
-            for (size_t i = 0; i < _Capacity; i++) {
-                if (objects[i] && objects[i]->bounds.intersects(_Bounds)) {
-                    _Objects[_Length++] = objects[i];
-                }
+        void release() const {
+            for (const PageRef& ref : pages) {
+                if (ref.owned.load(std::memory_order_relaxed))
+                    ref.owned.store(false, std::memory_order_relaxed);
             }
         }
+
+        std::vector<PageRef> pages;
+        std::vector<Index> free_blocks;
+        size_t count = 0;
+    };
+
+    // work counters, kept per thread so concurrent queries never share
+    // them. reset before an operation and read afterwards, the workers of
+    // parallel_query() and build() count into their own threads
+    struct QuadTreeStats {
+        // nodes whose slots or children were looked at
+        uint64_t nodes_visited = 0;
+        // nodes skipped because their loose bounds missed the query
+        uint64_t nodes_pruned = 0;
+        // object bounds tested against a query
+        uint64_t slot_tests = 0;
+        // objects reported
+        uint64_t hits = 0;
+        uint64_t splits = 0;
+        uint64_t merges = 0;
+        // loose bounds grown or refit on the way to the root
+        uint64_t bound_updates = 0;
+
+        void reset() { *this = QuadTreeStats(); }
+    };
+
+    inline QuadTreeStats& get_stats() {
+        static thread_local QuadTreeStats stats;
+        return stats;
     }
 
-    template<typename T, size_t _Capacity>
-    inline void QuadTree<T, _Capacity>::query(const QuadTreeAABB<T>& _Bounds,
-        std::vector<std::shared_ptr<QuadTreeObject<T>>>& _Objects, bool _BoundChecks) const
-    {
-        if (max_bounds.intersects(_Bounds) || !_BoundChecks) {
-            if (has_children) {
-                children[0]->query(_Bounds, _Objects, _BoundChecks);
-                children[1]->query(_Bounds, _Objects, _BoundChecks);
-                children[2]->query(_Bounds, _Objects, _BoundChecks);
-                children[3]->query(_Bounds, _Objects, _BoundChecks);
-            }
+    // worker threads shared by the parallel build and parallel_query().
+    // threads are started on first use, grow to the largest count asked
+    // for and then sleep between jobs, so a query does not pay for
+    // creating threads. one job runs at a time, a caller arriving while
+    // the workers are busy runs its tasks on its own thread
+    class QuadTreeWorkers {
+    public:
+        typedef std::function<void(size_t, size_t)> Task;
 
-            if (object_count < 1)
-                return;
+        static QuadTreeWorkers& get() {
+            static QuadTreeWorkers workers;
+            return workers;
+        }
 
-            for (size_t i = 0; i < _Capacity; i++) {
-                if (objects[i] && objects[i]->bounds.intersects(_Bounds)) {
-                    _Objects.push_back(objects[i]);
-                }
-            }
+        QuadTreeWorkers() = default;
+        QuadTreeWorkers(const QuadTreeWorkers&) = delete;
+        QuadTreeWorkers& operator=(const QuadTreeWorkers&) = delete;
+        ~QuadTreeWorkers();
+
+        // runs _Task(task, worker) for every task in [0, _Count) on up to
+        // _Threads threads including the calling one, which is worker 0.
+        // the first exception thrown by a task is rethrown here once every
+        // worker has stopped
+        void run(size_t _Count, size_t _Threads, const Task& _Task);
+
+        size_t size() const { return threads.size(); }
+    private:
+        void work(size_t _Worker, uint64_t _Generation);
+        void drain(size_t _Worker);
+
+        std::mutex run_mutex;
+        std::mutex mutex;
+        std::condition_variable wake;
+        std::condition_variable done;
+        std::vector<std::thread> threads;
+
+        // the current job, written under mutex before a new generation
+        const Task* task = nullptr;
+        size_t task_count = 0;
+        size_t participants = 0;
+        size_t pending = 0;
+        uint64_t generation = 0;
+        bool stop = false;
+        std::atomic<size_t> next{0};
+        std::exception_ptr error;
+    };
+
+    inline QuadTreeWorkers::~QuadTreeWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
         }
+
+        wake.notify_all();
+
+        for (std::thread& thread : threads)
+            thread.join();
     }
 
-    template<typename T, size_t _Capacity>
-    inline size_t QuadTree<T, _Capacity>::get_total_objects() const
+    inline void QuadTreeWorkers::run(size_t _Count, size_t _Threads, const Task& _Task)
     {
-        size_t obj_count = object_count;
+        _Threads = std::min(_Threads, _Count);
+
+        std::unique_lock<std::mutex> running(run_mutex, std::try_to_lock);
 
-        if (has_children) {
-            obj_count += children[0]->get_total_objects() +
-                children[1]->get_total_objects() +
-                children[2]->get_total_objects() +
-                children[3]->get_total_objects();
+        if (_Threads < 2 || !running.owns_lock()) {
+            for (size_t i = 0; i < _Count; i++)
+                _Task(i, 0);
+            return;
         }
 
-        return obj_count;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            // new threads start on the current generation so they take
+            // part in the job published below
+            while (threads.size() < _Threads - 1)
+                threads.emplace_back(&QuadTreeWorkers::work, this, threads.size() + 1, generation);
+
+            task = &_Task;
+            task_count = _Count;
+            participants = _Threads;
+            pending = _Threads - 1;
+            next = 0;
+            error = nullptr;
+            generation++;
+        }
+
+        wake.notify_all();
+        drain(0);
+
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this] { return pending == 0; });
+
+        task = nullptr;
+
+        if (error)
+            std::rethrow_exception(error);
+    }
+
+    inline void QuadTreeWorkers::work(size_t _Worker, uint64_t _Generation)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        for (;;) {
+            wake.wait(lock, [&] { return stop || generation != _Generation; });
+
+            if (stop)
+                return;
+
+            _Generation = generation;
+
+            if (_Worker >= participants)
+                continue;
+
+            lock.unlock();
+            drain(_Worker);
+            lock.lock();
+
+            if (--pending == 0)
+                done.notify_one();
+        }
+    }
+
+    inline void QuadTreeWorkers::drain(size_t _Worker)
+    {
+        try {
+            for (size_t i = next++; i < task_count; i = next++)
+                (*task)(i, _Worker);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            if (!error)
+                error = std::current_exception();
+
+            // the remaining tasks are dropped
+            next = task_count;
+        }
+    }
+
+    // shape of a tree, see QuadTree::get_shape(). the vectors are indexed
+    // by node level, the root is on level 1
+    struct QuadTreeShape {
+        // nodes, leaves and objects on each level
+        std::vector<size_t> nodes;
+        std::vector<size_t> leaves;
+        std::vector<size_t> objects;
+        // objects per inline slot on each level, above 1 with overflow
+        std::vector<double> occupancy;
+
+        size_t node_count = 0;
+        size_t max_depth = 0;
+
+        // the area where the loose bounds of siblings intersect, relative
+        // to the area of the loose bounds of all siblings. 0 when no
+        // sibling overlaps, high values mean queries descend into many
+        // subtrees at once
+        double sibling_overlap = 0;
+    };
+
+    // where insert() puts an object that straddles the quadrants of a
+    // full node. FirstFit hands it to the first child it touches, which
+    // then grows its loose bounds to cover it. Contained keeps it at the
+    // smallest node that fully contains it, so inner nodes hold the
+    // straddling objects and the loose bounds stay close to the nodes
+    enum class QuadTreePlacement {
+        FirstFit,
+        Contained
+    };
+
+    // decides when a full node splits. a node that may not split keeps
+    // the objects past its capacity in an overflow list instead
+    template <typename T>
+    struct QuadTreeSplitPolicy {
+        // objects a node holds before it splits, 0 uses the capacity of
+        // the tree. above the capacity the rest go to the overflow list
+        size_t capacity = 0;
+
+        // levels including the root, nodes on the last level never split
+        size_t max_depth = 32;
+
+        // nodes split only while their quadrants stay at least this large
+        T min_size = T();
+
+        // optional extra check, called with the node bounds, its level and
+        // its object count once the limits above allow a split
+        std::function<bool(const QuadTreeAABB<T>&, size_t, size_t)> split;
+    };
+
+    // when subtrees are folded back into their root after removals. a
+    // subtree merges once it holds threshold objects or fewer, they move
+    // up into its root. the threshold is kept below the split capacity,
+    // so the gap between the two stops a node that takes and loses one
+    // object from splitting and merging every time
+    struct QuadTreeMergePolicy {
+        // 0 only merges subtrees left empty
+        size_t threshold = 0;
+
+        // ticks a subtree has to stay at or below the threshold before it
+        // merges, counted by QuadTree::tick(). 0 merges on the removal
+        size_t delay = 0;
+    };
+
+    // node of the flat layout written by QuadTree::serialize(). nodes are
+    // in breadth first order, the children of a node are contiguous and
+    // empty subtrees are left out
+    template <typename T>
+    struct QuadTreeFlatNode {
+        // loose bounds of the subtree
+        T left, top, right, bottom;
+
+        uint32_t first_child;
+        uint32_t child_count;
+
+        // the objects of a node are contiguous in the object arrays
+        uint32_t first_object;
+        uint32_t object_count;
+    };
+
+    // a serialized tree is this header followed by the node array and one
+    // array per object edge and for the ids. offsets are in bytes from the
+    // start of the header, so the data can live anywhere in memory
+    struct QuadTreeFileHeader {
+        static constexpr uint32_t kMagic = 0x5451434e; // "NCQT"
+        static constexpr uint32_t kVersion = 1;
+
+        uint32_t magic;
+        uint32_t version;
+
+        // coordinate type of the tree
+        uint32_t scalar_size;
+        uint32_t scalar_floating;
+
+        uint64_t size;
+        uint64_t node_count;
+        uint64_t object_count;
+
+        uint64_t nodes;
+        uint64_t left, top, right, bottom;
+        uint64_t ids;
+    };
+
+    // calls _Func(uint32_t object) for every object below _Node whose
+    // bounds intersect _Bounds, shared by QuadTreeView and QuadTreeFrozen
+    template <typename T, typename _Visitor>
+    inline bool query_flat(const QuadTreeFlatNode<T>* _Nodes, const T* _Left, const T* _Top,
+        const T* _Right, const T* _Bottom, uint32_t _Node, const QuadTreeAABB<T>& _Bounds, _Visitor& _Func)
+    {
+        const QuadTreeFlatNode<T>& node = _Nodes[_Node];
+
+        if (!(node.left < _Bounds.right && node.right > _Bounds.left &&
+            node.top < _Bounds.bottom && node.bottom > _Bounds.top))
+            return true;
+
+        // the objects of a node are scanned in chunks so the hit buffer
+        // stays on the stack however many objects overflowed into it
+        static constexpr uint32_t kChunk = 64;
+        uint32_t hits[kChunk];
+
+        for (uint32_t first = node.first_object; first < node.first_object + node.object_count; first += kChunk) {
+            size_t count = std::min(kChunk, node.first_object + node.object_count - first);
+            size_t hit_count = query_batch(_Bounds, _Left + first, _Top + first, _Right + first, _Bottom + first,
+                count, hits);
+
+            for (size_t i = 0; i < hit_count; i++) {
+                if (!call_visitor(_Func, first + hits[i]))
+                    return false;
+            }
+        }
+
+        for (uint32_t i = 0; i < node.child_count; i++) {
+            if (!query_flat(_Nodes, _Left, _Top, _Right, _Bottom, node.first_child + i, _Bounds, _Func))
+                return false;
+        }
+
+        return true;
+    }
+
+    template <typename T>
+    class QuadTreeFrozen;
+
+    template <typename T = double, size_t _Capacity = 2>
+    class QuadTree {
+    public:
+        using Object = QuadTreeObject<T>;
+        using ObjectPtr = std::shared_ptr<Object>;
+        using NodeIndex = uint32_t;
+
+        static constexpr NodeIndex kNullNode = ~NodeIndex(0);
+
+        // distances are computed in double for integer coordinates
+        using Distance = QuadTreeScalar<T>;
+
+        // a mutation for apply(), bounds is the target of an update
+        enum class OperationType {
+            Insert,
+            Remove,
+            Update
+        };
+
+        struct Operation {
+            OperationType type;
+            ObjectPtr object;
+            QuadTreeAABB<T> bounds;
+        };
+
+        struct Neighbor {
+            ObjectPtr object;
+            Distance distance;
+        };
+
+        struct OverflowSlot {
+            QuadTreeAABB<T> bounds;
+            ObjectPtr object;
+        };
+
+        struct Node {
+            QuadTreeAABB<T> bounds;
+            QuadTreeAABB<T> max_bounds;
+
+            // slots [0, object_count) are occupied, the bounds of each
+            // object are copied inline so leaf scans never touch the
+            // object itself
+            QuadTreeAABBArray<T, _Capacity> object_bounds;
+            std::array<ObjectPtr, _Capacity> objects;
+            size_t object_count = 0;
+
+            // slots from _Capacity on, only used once the inline slots are
+            // full and the split policy stops the node from splitting
+            std::vector<OverflowSlot> overflow;
+
+            // objects in this node and all of its descendants
+            size_t total_count = 0;
+
+            // children are kChildren contiguous nodes in the pool
+            NodeIndex first_child = kNullNode;
+            NodeIndex parent = kNullNode;
+
+            size_t level = 1;
+
+            // max_bounds may be larger than needed, see commit()
+            bool dirty = false;
+
+            // tick + 1 at which a delayed merge of this node was scheduled
+            uint32_t merge_tick = 0;
+
+            bool has_children() const { return first_child != kNullNode; }
+
+            // inline and overflow slots together
+            size_t slot_count() const { return object_count + overflow.size(); }
+
+            const ObjectPtr& get_object(size_t _Slot) const {
+                return _Slot < _Capacity ? objects[_Slot] : overflow[_Slot - _Capacity].object;
+            }
+
+            QuadTreeAABB<T> get_object_bounds(size_t _Slot) const {
+                return _Slot < _Capacity ? object_bounds.get(_Slot) : overflow[_Slot - _Capacity].bounds;
+            }
+
+            void set_object_bounds(size_t _Slot, const QuadTreeAABB<T>& _Bounds) {
+                if (_Slot < _Capacity)
+                    object_bounds.set(_Slot, _Bounds);
+                else
+                    overflow[_Slot - _Capacity].bounds = _Bounds;
+            }
+
+            void set_object(size_t _Slot, const ObjectPtr& _Object) {
+                if (_Slot < _Capacity)
+                    objects[_Slot] = _Object;
+                else
+                    overflow[_Slot - _Capacity].object = _Object;
+            }
+        };
+
+        // resumable query from query_cursor(). the traversal stack lives in
+        // the cursor, so a large query can be spread over several calls and
+        // results are handed out as they are found. the tree must outlive
+        // the cursor and must not change while a call runs, a call after
+        // the tree changed throws std::logic_error. the check reads the
+        // plain version counter of the tree, so it only sees mutations
+        // ordered before the call, e.g. made on the same thread between
+        // calls. another thread mutating the tree concurrently is a data
+        // race, query a QuadTreeConcurrent snapshot instead
+        class QueryCursor {
+        public:
+            using Clock = std::chrono::steady_clock;
+
+            QueryCursor() {}
+
+            // passes up to _Max more results to _Func(const ObjectPtr&). if
+            // _Func returns a bool, false pauses the query after that
+            // object. returns the number of objects passed
+            template <typename _Visitor>
+            size_t next(_Visitor&& _Func, size_t _Max = std::numeric_limits<size_t>::max());
+
+            // the same, also pauses once _Budget has passed. the clock is
+            // only read every few nodes, so a call can run slightly over
+            template <typename _Visitor>
+            size_t next(_Visitor&& _Func, size_t _Max, Clock::duration _Budget);
+
+            // appends the results to _Objects
+            size_t next(std::vector<ObjectPtr>& _Objects, size_t _Max = std::numeric_limits<size_t>::max()) {
+                auto append = [&](const ObjectPtr& _Object) { _Objects.push_back(_Object); };
+                return next(append, _Max);
+            }
+
+            size_t next(std::vector<ObjectPtr>& _Objects, size_t _Max, Clock::duration _Budget) {
+                auto append = [&](const ObjectPtr& _Object) { _Objects.push_back(_Object); };
+                return next(append, _Max, _Budget);
+            }
+
+            bool done() const { return node == kNullNode && stack.empty(); }
+
+            // whether the tree changed since the query started, same thread
+            // or otherwise synchronized mutations only, see above
+            bool stale() const { return tree && tree->version != version; }
+        private:
+            friend class QuadTree;
+
+            // nodes between clock reads under a time budget
+            static constexpr size_t kClockInterval = 16;
+
+            QueryCursor(const QuadTree* _Tree, const QuadTreeAABB<T>& _Bounds);
+
+            template <typename _Visitor>
+            size_t run(_Visitor& _Func, size_t _Max, const Clock::time_point* _Deadline);
+
+            const QuadTree* tree = nullptr;
+            QuadTreeAABB<T> bounds;
+            uint64_t version = 0;
+
+            // nodes left to visit
+            std::vector<NodeIndex> stack;
+
+            // the node whose objects are being passed, its inline hits and
+            // the next hit and overflow slot
+            NodeIndex node = kNullNode;
+            std::array<uint32_t, _Capacity> hits;
+            size_t hit_count = 0;
+            size_t hit = 0;
+            size_t overflow = 0;
+        };
+    private:
+        static constexpr size_t kChildren = 4;
+
+        // bounds are copied next to the key so partitioning scans the
+        // sorted items without chasing the object pointers
+        struct BuildItem {
+            uint64_t code;
+            QuadTreeAABB<T> bounds;
+            ObjectPtr object;
+        };
+
+        // a subtree of a parallel build, built into its own tree and
+        // spliced in afterwards
+        struct BuildTask {
+            NodeIndex node;
+            BuildItem* first;
+            BuildItem* last;
+            int shift;
+            std::vector<ObjectPtr> deferred;
+            std::unique_ptr<QuadTree> subtree;
+        };
+
+        // below this many objects a build or a build task is not split up
+        static constexpr size_t kParallelBuildGrain = 16384;
+
+        QuadTreeNodePool<Node> nodes;
+        NodeIndex root = kNullNode;
+
+        bool deferred_bounds = false;
+
+        // between begin_batch() and end_batch() empty nodes are kept and
+        // the loose bounds are deferred
+        bool batching = false;
+        bool batch_deferred_bounds = false;
+
+        QuadTreeSplitPolicy<T> policy;
+        QuadTreePlacement placement = QuadTreePlacement::FirstFit;
+
+        QuadTreeMergePolicy merge_policy;
+        uint32_t ticks = 0;
+
+        // nodes waiting for a delayed merge, with their merge_tick. an
+        // entry is stale once the node's merge_tick no longer matches
+        std::vector<std::pair<NodeIndex, uint32_t>> pending_merges;
+
+        // optional id -> node/slot map, indexed directly by object id
+        struct IndexEntry {
+            NodeIndex node = kNullNode;
+            uint32_t slot = 0;
+        };
+
+        std::vector<IndexEntry> index;
+        bool index_enabled = false;
+
+        bool grow_enabled = false;
+        bool copy_on_update = false;
+
+        // changes with every mutation, see QueryCursor. not atomic, like
+        // the rest of the tree it is only written by the mutating thread
+        uint64_t version = 0;
+
+        void index_set(size_t _Id, NodeIndex _Node, size_t _Slot);
+        void index_rebuild(NodeIndex _Node);
+
+        size_t split_capacity() const { return policy.capacity > 0 ? policy.capacity : _Capacity; }
+
+        // whether the split policy lets _Node split to hold _Count objects
+        bool can_split(NodeIndex _Node, size_t _Count) const;
+        void split(NodeIndex _Node);
+        void merge(NodeIndex _Node);
+
+        size_t merge_threshold() const {
+            return std::min(merge_policy.threshold, split_capacity() - 1);
+        }
+
+        // whether the subtree below _Node is sparse enough to merge
+        bool can_merge(NodeIndex _Node) const;
+        // merges the children of _Node and moves their objects into it
+        void pull_up(NodeIndex _Node);
+        void pull_up(NodeIndex _Node, NodeIndex _From);
+        // merges or schedules the highest sparse ancestor after a removal,
+        // returns the node that is left in place of _Node
+        NodeIndex collapse(NodeIndex _Node);
+        void fit_max_bounds(NodeIndex _Node);
+        void resolve_max_bounds(NodeIndex _Node);
+        void expand_max_bounds(NodeIndex _Node, const QuadTreeAABB<T>& _Bounds);
+        void shrink_max_bounds(NodeIndex _Node);
+        void commit(NodeIndex _Node);
+        // points the children and the index entries of a node that was
+        // moved to _Node back at it
+        void adopt(NodeIndex _Node);
+        void relevel(NodeIndex _Node, size_t _Level);
+
+        // merges every sparse subtree, marks the changed paths dirty.
+        // true if anything was merged
+        bool compact(NodeIndex _Node);
+
+        void build(NodeIndex _Node, BuildItem* _First, BuildItem* _Last,
+            int _Shift, std::vector<ObjectPtr>& _Deferred);
+        void partition(NodeIndex _Node, BuildItem* _First, BuildItem* _Last, int _Shift,
+            std::vector<ObjectPtr>& _Deferred, BuildItem** _Begins, BuildItem** _Ends);
+
+        void build_parallel(BuildItem* _First, BuildItem* _Last, size_t _Threads,
+            std::vector<ObjectPtr>& _Deferred);
+        void partition_tasks(NodeIndex _Node, BuildItem* _First, BuildItem* _Last, int _Shift,
+            size_t _Depth, std::vector<BuildTask>& _Tasks, std::vector<NodeIndex>& _Inner,
+            std::vector<ObjectPtr>& _Deferred);
+        void graft(BuildTask& _Task);
+
+        static void sort_items(std::vector<BuildItem>& _Items, size_t _Threads);
+
+        // runs _Task(task, worker) for every task in [0, _Count) on up to
+        // _Threads threads including the calling one, see QuadTreeWorkers
+        template <typename _Func>
+        static void run_parallel(size_t _Count, size_t _Threads, _Func&& _Task);
+
+        bool insert(NodeIndex _Node, const ObjectPtr& _Object);
+        bool insert_contained(NodeIndex _Node, const ObjectPtr& _Object);
+        // the child of _Node that fully contains _Bounds, or kNullNode
+        NodeIndex containing_child(NodeIndex _Node, const QuadTreeAABB<T>& _Bounds) const;
+        // moves the objects of a freshly split node into the children
+        // that contain them
+        void push_down(NodeIndex _Node);
+        // without the index the search descends through nodes touching
+        // _Bounds, or through the whole tree if _Bounds is null
+        bool locate(size_t _Id, const QuadTreeAABB<T>* _Bounds,
+            NodeIndex& _Owner, size_t& _Slot) const;
+        bool locate(NodeIndex _Node, size_t _Id, const QuadTreeAABB<T>* _Bounds,
+            NodeIndex& _Owner, size_t& _Slot) const;
+
+        // update() with _Moved, the object or a copy of it, taking the
+        // place of _Object
+        bool move(const ObjectPtr& _Object, const ObjectPtr& _Moved, const QuadTreeAABB<T>& _Bounds);
+
+        void place(NodeIndex _Node, const ObjectPtr& _Object);
+        // clears a slot without touching the counts or the bounds
+        void take(NodeIndex _Node, size_t _Slot);
+        void erase(NodeIndex _Node, size_t _Slot);
+
+        template <typename _Visitor>
+        bool query(NodeIndex _Node, const QuadTreeAABB<T>& _Boundaries,
+            _Visitor& _Func, bool _BoundChecks) const;
+        template <typename _Shape, typename _Visitor>
+        bool query_shape(NodeIndex _Node, const _Shape& _Query, const QuadTreeAABB<T>& _Boundaries,
+            _Visitor& _Func) const;
+
+        // queue entry of nearest() and raycast(), keyed by distance along
+        // the ray or from the point. slot is kNodeEntry for nodes
+        struct QueueEntry {
+            Distance distance;
+            NodeIndex node;
+            uint32_t slot;
+
+            bool operator<(const QueueEntry& _Other) const {
+                // std::priority_queue is a max heap
+                return distance > _Other.distance;
+            }
+        };
+
+        static constexpr uint32_t kNodeEntry = ~uint32_t(0);
+
+        static Distance distance_squared(const QuadTreeAABB<T>& _Bounds, Distance _X, Distance _Y);
+
+        // slab test, _Entry is where the ray enters _Bounds
+        static bool ray_entry(const QuadTreeAABB<T>& _Bounds, Distance _X, Distance _Y,
+            Distance _DirX, Distance _DirY, Distance _MaxT, Distance& _Entry);
+
+        // broadphase helpers, the other tree is only used through its
+        // public node accessors so any capacity works
+        template <typename _Visitor>
+        bool pairs_self(NodeIndex _Node, _Visitor& _Func) const;
+        template <typename _Other, typename _Visitor>
+        bool pairs_cross(NodeIndex _Node, const _Other& _Tree, typename _Other::NodeIndex _OtherNode,
+            _Visitor& _Func) const;
+        template <typename _Other, typename _Visitor>
+        static bool pairs_object(const QuadTreeAABB<T>& _Bounds, const ObjectPtr& _Object,
+            const _Other& _Tree, typename _Other::NodeIndex _Node, bool _Swapped, _Visitor& _Func);
+
+        struct QueryHit {
+            uint32_t query;
+            const ObjectPtr* object;
+        };
+
+        void query_many(NodeIndex _Node, const QuadTreeAABB<T>* _Queries,
+            std::vector<uint32_t>& _Active, size_t _Begin, std::vector<QueryHit>& _Hits) const;
+
+        void collect_tasks(NodeIndex _Node, const QuadTreeAABB<T>& _Boundaries, size_t _Grain,
+            std::vector<NodeIndex>& _Tasks, std::vector<ObjectPtr>& _Objects) const;
+
+        void add_total(NodeIndex _Node);
+        void sub_total(NodeIndex _Node);
+
+        // the nodes in breadth first order without empty subtrees, the
+        // objects and their bounds as stored in the slots in the order the
+        // flat nodes refer to them
+        void flatten(std::vector<QuadTreeFlatNode<T>>& _Nodes, std::vector<const ObjectPtr*>& _Objects,
+            std::vector<QuadTreeAABB<T>>& _Bounds) const;
+    public:
+        QuadTree() {
+            root = nodes.allocate();
+        }
+
+        QuadTree(const QuadTreeAABB<T>& _Bounds) {
+            root = nodes.allocate();
+            set_bounds(_Bounds);
+        }
+
+        QuadTree(const QuadTreeAABB<T>& _Bounds, const QuadTreeSplitPolicy<T>& _Policy)
+            : policy(_Policy) {
+            root = nodes.allocate();
+            set_bounds(_Bounds);
+        }
+
+        ~QuadTree() {
+        }
+
+        void set_bounds(const QuadTreeAABB<T>& _Bounds) {
+            version++;
+            nodes[root].bounds = _Bounds;
+            nodes[root].max_bounds = _Bounds;
+        }
+
+        void resolve_max_bounds() {
+            resolve_max_bounds(root);
+        }
+
+        // when enabled, removals only mark the path to the root dirty and
+        // the loose bounds are tightened by the next commit(). a stale
+        // max_bounds is always larger than needed, so queries stay exact
+        // and only prune less until then
+        void set_deferred_bounds(bool _Deferred) {
+            // a batch defers the bounds anyway, end_batch() restores this
+            if (batching) {
+                batch_deferred_bounds = _Deferred;
+                return;
+            }
+
+            deferred_bounds = _Deferred;
+
+            if (!_Deferred)
+                commit();
+        }
+
+        bool get_deferred_bounds() const { return deferred_bounds; }
+
+        // applies to splits from now on, existing nodes are kept as they are
+        void set_split_policy(const QuadTreeSplitPolicy<T>& _Policy) {
+            policy = _Policy;
+        }
+
+        const QuadTreeSplitPolicy<T>& get_split_policy() const { return policy; }
+
+        // applies to inserts from now on, call build() to place the
+        // objects already in the tree again
+        void set_placement(QuadTreePlacement _Placement) {
+            placement = _Placement;
+        }
+
+        QuadTreePlacement get_placement() const { return placement; }
+
+        // applies to removals from now on, compact() merges what the old
+        // policy left behind
+        void set_merge_policy(const QuadTreeMergePolicy& _Policy) {
+            merge_policy = _Policy;
+        }
+
+        const QuadTreeMergePolicy& get_merge_policy() const { return merge_policy; }
+
+        // advances the merge clock by one step and merges the subtrees
+        // that stayed sparse for the delay of the merge policy
+        void tick();
+
+        // merges every sparse subtree right away, whatever the delay
+        void compact();
+
+        // refits every dirty node bottom up
+        void commit() {
+            commit(root);
+        }
+
+        const QuadTreeAABB<T>& get_bounds() const {
+            return nodes[root].bounds;
+        }
+
+        const QuadTreeAABB<T>& get_max_bounds() const {
+            return nodes[root].max_bounds;
+        }
+
+        bool insert(const ObjectPtr& _Object) {
+            if (grow_enabled)
+                grow(_Object->bounds);
+
+            return insert(root, _Object);
+        }
+
+        bool remove(const ObjectPtr& _Object);
+        bool remove(size_t _Id);
+
+        // returns the object with the given id, or null if it is not in
+        // the tree. O(1) with the index, a full traversal without it
+        ObjectPtr find(size_t _Id) const;
+
+        // keeps a dense id -> node/slot map so remove(), find() and
+        // update() go straight to the owning slot. the map is indexed by
+        // id, so ids should be small and dense
+        void set_index_enabled(bool _Enabled);
+
+        bool get_index_enabled() const { return index_enabled; }
+
+        // lets insert(), update() and build() grow the root to fit objects
+        // outside of it instead of skipping them, compact() then also
+        // shrinks it again
+        void set_grow_enabled(bool _Enabled) {
+            grow_enabled = _Enabled;
+        }
+
+        bool get_grow_enabled() const { return grow_enabled; }
+
+        // doubles the root towards _Bounds until it contains them, the old
+        // root becomes a quadrant of the new one so the nodes below keep
+        // their bounds. false if the coordinates cannot grow that far
+        bool grow(const QuadTreeAABB<T>& _Bounds);
+
+        // replaces the root with its only occupied quadrant for as long as
+        // the root holds no objects itself. returns the levels removed
+        size_t shrink();
+
+        // moves _Object to _Bounds. the object stays in its node while it
+        // still overlaps it, otherwise it is reinserted below the closest
+        // ancestor that contains the new bounds. returns false if the
+        // object is not in the tree or the new bounds leave the root.
+        // with copy on update the object is replaced instead, see below
+        bool update(const ObjectPtr& _Object, const QuadTreeAABB<T>& _Bounds);
+
+        // like update(), but _Object is left untouched for whoever still
+        // reads it, e.g. a snapshot sharing it. a copy carrying _Bounds
+        // takes its place and is returned, null where update() fails
+        ObjectPtr replace(const ObjectPtr& _Object, const QuadTreeAABB<T>& _Bounds);
+
+        // makes update() and the update operations of apply() go through
+        // replace(), so objects other threads may read are never written.
+        // the copies are handed out by replace() and apply()
+        void set_copy_on_update(bool _Enabled) {
+            copy_on_update = _Enabled;
+        }
+
+        bool get_copy_on_update() const { return copy_on_update; }
+
+        // groups many mutations. in between, removals leave empty nodes in
+        // place and loose bounds are only marked dirty, end_batch() then
+        // frees the empty subtrees and refits the dirty nodes in one pass.
+        // queries stay exact during a batch
+        void begin_batch();
+        void end_batch();
+
+        bool get_batching() const { return batching; }
+
+        // applies _Count operations in z-order of their objects so
+        // consecutive operations touch nearby nodes. operations on the
+        // same object keep their relative order. runs as its own batch
+        // unless one is open, returns the number of operations that
+        // succeeded. with copy on update, later operations on a replaced
+        // object act on its copy and _Objects, if given, receives the
+        // object each operation acted on, for updates the copy, null
+        // where the operation failed
+        size_t apply(const Operation* _Operations, size_t _Count, ObjectPtr* _Objects = nullptr);
+
+        size_t apply(const std::vector<Operation>& _Operations) {
+            return apply(_Operations.data(), _Operations.size());
+        }
+
+        // replaces the contents of the tree with [_Begin, _End), objects
+        // are sorted along a z-order curve and partitioned top down so
+        // every node is visited once. objects outside the root bounds are
+        // skipped, returns the number of objects added.
+        // with _Threads != 1 (0 uses every hardware thread) large inputs
+        // are sorted in parallel and the subtrees below the top levels are
+        // built concurrently
+        template <typename _Iterator>
+        size_t build(_Iterator _Begin, _Iterator _End, size_t _Threads = 1);
+
+        void query(const QuadTreeAABB<T>& _Boundaries,
+            ObjectPtr* _Objects, size_t& _Length,
+            bool _BoundChecks = true) const {
+            auto append = [&](const ObjectPtr& _Object) { _Objects[_Length++] = _Object; };
+            query(root, _Boundaries, append, _BoundChecks);
+        }
+
+        void query(const QuadTreeAABB<T>& _Boundaries,
+            std::vector<ObjectPtr>& _Objects,
+            bool _BoundChecks = true) const {
+            auto append = [&](const ObjectPtr& _Object) { _Objects.push_back(_Object); };
+            query(root, _Boundaries, append, _BoundChecks);
+        }
+
+        // calls _Func(const ObjectPtr&) for every object intersecting
+        // _Boundaries without copying the handle. if _Func returns a bool,
+        // false stops the query. returns false if it was stopped early
+        template <typename _Visitor>
+        bool query(const QuadTreeAABB<T>& _Boundaries, _Visitor&& _Func) const {
+            return query(root, _Boundaries, _Func, true);
+        }
+
+        // queries with an arbitrary shape such as QuadTreeCircle,
+        // QuadTreeOrientedBox or QuadTreeConvexPolygon. subtrees whose
+        // max_bounds miss the shape are pruned and only exact hits are
+        // reported
+        template <typename _Shape, typename _Visitor>
+        bool query(const _Shape& _Query, _Visitor&& _Func) const {
+            return query_shape(root, _Query, _Query.get_bounds(), _Func);
+        }
+
+        template <typename _Shape>
+        void query(const _Shape& _Query, std::vector<ObjectPtr>& _Objects) const {
+            auto append = [&](const ObjectPtr& _Object) { _Objects.push_back(_Object); };
+            query_shape(root, _Query, _Query.get_bounds(), append);
+        }
+
+        // the _Count objects closest to (_X, _Y) that are at most
+        // _MaxDistance away, sorted by distance to their bounds (0 when
+        // the point is inside). nodes are visited best first by their
+        // distance to max_bounds, so far subtrees are never opened
+        void nearest(T _X, T _Y, size_t _Count, std::vector<Neighbor>& _Neighbors,
+            Distance _MaxDistance = std::numeric_limits<Distance>::max()) const;
+
+        // calls _Func(const ObjectPtr&, Distance t) for the objects hit by
+        // the ray (_X, _Y) + t * (_DirX, _DirY), 0 <= t <= _MaxT, in order
+        // of the t at which the ray enters them. nodes are opened front to
+        // back by where the ray enters their max_bounds. returning false
+        // from _Func stops the cast, so stopping at the first call gives
+        // the closest hit. returns false if it was stopped
+        template <typename _Visitor>
+        bool raycast(Distance _X, Distance _Y, Distance _DirX, Distance _DirY,
+            Distance _MaxT, _Visitor&& _Func) const;
+
+        // calls _Func(const ObjectPtr&, const ObjectPtr&) once for every
+        // pair of objects whose bounds intersect, found in a single
+        // simultaneous descent of sibling subtrees. returning false from
+        // _Func stops the search, returns false if it was stopped
+        template <typename _Visitor>
+        bool for_each_overlapping_pair(_Visitor&& _Func) const {
+            return pairs_self(root, _Func);
+        }
+
+        // same between two trees, _Func gets an object of this tree first
+        // and an object of _Other second
+        template <size_t _OtherCapacity, typename _Visitor>
+        bool for_each_overlapping_pair(const QuadTree<T, _OtherCapacity>& _Other, _Visitor&& _Func) const {
+            return pairs_cross(root, _Other, _Other.get_root(), _Func);
+        }
+
+        // runs _Count queries in one traversal, each node is visited once
+        // with the subset of queries still touching it. the hits of query
+        // i end up in _Objects[_Offsets[i], _Offsets[i + 1])
+        void query_many(const QuadTreeAABB<T>* _Queries, size_t _Count,
+            std::vector<size_t>& _Offsets, std::vector<ObjectPtr>& _Objects) const;
+
+        void query_many(const std::vector<QuadTreeAABB<T>>& _Queries,
+            std::vector<size_t>& _Offsets, std::vector<ObjectPtr>& _Objects) const {
+            query_many(_Queries.data(), _Queries.size(), _Offsets, _Objects);
+        }
+
+        // same result set as query(), in unspecified order. the parts of
+        // the tree touching _Boundaries are cut into subtrees of about
+        // _Grain objects which _Threads workers pull from a shared cursor
+        // (0 uses every hardware thread). when the subtrees touched hold
+        // fewer than two grains of objects they are queried serially
+        void parallel_query(const QuadTreeAABB<T>& _Boundaries,
+            std::vector<ObjectPtr>& _Objects,
+            size_t _Threads = 0, size_t _Grain = 4096) const;
+
+        bool has_children_() const { return nodes[root].has_children(); }
+
+        // read-only access to the node structure, children of a node are
+        // get_node(first_child + 0..3)
+        NodeIndex get_root() const { return root; }
+        const Node& get_node(NodeIndex _Node) const { return nodes[_Node]; }
+
+        // walks the whole tree, meant for tuning rather than the hot path
+        QuadTreeShape get_shape() const;
+
+        // writes the tree in the flat layout described at
+        // QuadTreeFileHeader, with the ids of the objects but not their
+        // user data. QuadTreeView queries the result in place
+        void serialize(std::vector<uint8_t>& _Data) const;
+
+        // immutable copy in the flat layout of serialize(), keeping the
+        // object pointers. the tree itself is left unchanged
+        QuadTreeFrozen<T> freeze() const;
+
+        // starts a query that is run piecewise through the cursor
+        QueryCursor query_cursor(const QuadTreeAABB<T>& _Bounds) const {
+            return QueryCursor(this, _Bounds);
+        }
+
+        // incremented by every insert, removal, move and rebuild
+        uint64_t get_version() const { return version; }
+
+        size_t get_total_objects() const {
+            return nodes[root].total_count;
+        }
+    };
+
+    // read-only tree over data written by QuadTree::serialize(), usually
+    // a memory mapped file. queries run directly on the data, which has to
+    // stay alive and unchanged for the lifetime of the view. the header and
+    // the node records are checked when the view is created, object
+    // coordinates and ids are taken as they are
+    template <typename T = double>
+    class QuadTreeView {
+        const uint8_t* data = nullptr;
+        const QuadTreeFileHeader* header = nullptr;
+        const QuadTreeFlatNode<T>* nodes = nullptr;
+        const T* left = nullptr;
+        const T* top = nullptr;
+        const T* right = nullptr;
+        const T* bottom = nullptr;
+        const uint64_t* ids = nullptr;
+
+    public:
+        QuadTreeView() {}
+
+        // throws std::invalid_argument if _Data does not hold a tree with
+        // coordinates of type T
+        QuadTreeView(const void* _Data, size_t _Size);
+
+        size_t get_node_count() const { return header ? header->node_count : 0; }
+        size_t get_total_objects() const { return header ? header->object_count : 0; }
+
+        const QuadTreeFlatNode<T>& get_node(uint32_t _Node) const { return nodes[_Node]; }
+
+        size_t get_object_id(size_t _Object) const { return static_cast<size_t>(ids[_Object]); }
+
+        QuadTreeAABB<T> get_object_bounds(size_t _Object) const {
+            return QuadTreeAABB<T>(left[_Object], top[_Object], right[_Object], bottom[_Object]);
+        }
+
+        // calls _Func(size_t id) for every object intersecting _Bounds,
+        // returning false from _Func stops the query
+        template <typename _Visitor>
+        bool query(const QuadTreeAABB<T>& _Bounds, _Visitor&& _Func) const {
+            auto visit = [&](uint32_t _Object) { return call_visitor(_Func, static_cast<size_t>(ids[_Object])); };
+            return !header || header->node_count < 1 || query_flat(nodes, left, top, right, bottom, 0, _Bounds, visit);
+        }
+
+        void query(const QuadTreeAABB<T>& _Bounds, std::vector<size_t>& _Ids) const {
+            auto append = [&](size_t _Id) { _Ids.push_back(_Id); };
+            query(_Bounds, append);
+        }
+    };
+
+    // immutable form of a QuadTree made by QuadTree::freeze(). it uses the
+    // layout of the serialized tree, so there are no per node slot arrays,
+    // no parent links and no empty subtrees, and the objects of all nodes
+    // are packed into one set of arrays
+    template <typename T = double>
+    class QuadTreeFrozen {
+    public:
+        using Object = QuadTreeObject<T>;
+        using ObjectPtr = std::shared_ptr<Object>;
+    private:
+        template <typename, size_t> friend class QuadTree;
+
+        QuadTreeAABB<T> bounds;
+
+        std::vector<QuadTreeFlatNode<T>> nodes;
+        std::vector<T> left, top, right, bottom;
+        std::vector<ObjectPtr> objects;
+
+        template <typename _Shape, typename _Visitor>
+        bool query_shape(uint32_t _Node, const _Shape& _Query, const QuadTreeAABB<T>& _Bounds,
+            _Visitor& _Func) const;
+    public:
+        QuadTreeFrozen() {}
+
+        const QuadTreeAABB<T>& get_bounds() const { return bounds; }
+
+        size_t get_node_count() const { return nodes.size(); }
+        const QuadTreeFlatNode<T>& get_node(uint32_t _Node) const { return nodes[_Node]; }
+
+        size_t get_total_objects() const { return objects.size(); }
+
+        // heap memory held by the frozen tree, without the objects
+        size_t get_memory() const {
+            return nodes.capacity() * sizeof(QuadTreeFlatNode<T>) +
+                (left.capacity() + top.capacity() + right.capacity() + bottom.capacity()) * sizeof(T) +
+                objects.capacity() * sizeof(ObjectPtr);
+        }
+
+        void query(const QuadTreeAABB<T>& _Boundaries, ObjectPtr* _Objects, size_t& _Length) const {
+            auto append = [&](const ObjectPtr& _Object) { _Objects[_Length++] = _Object; };
+            query(_Boundaries, append);
+        }
+
+        void query(const QuadTreeAABB<T>& _Boundaries, std::vector<ObjectPtr>& _Objects) const {
+            auto append = [&](const ObjectPtr& _Object) { _Objects.push_back(_Object); };
+            query(_Boundaries, append);
+        }
+
+        // calls _Func(const ObjectPtr&) for every object intersecting
+        // _Boundaries, returning false from _Func stops the query
+        template <typename _Visitor>
+        bool query(const QuadTreeAABB<T>& _Boundaries, _Visitor&& _Func) const {
+            auto visit = [&](uint32_t _Object) { return call_visitor(_Func, objects[_Object]); };
+            return nodes.empty() || query_flat(nodes.data(), left.data(), top.data(), right.data(),
+                bottom.data(), 0, _Boundaries, visit);
+        }
+
+        // exact shape queries as in QuadTree
+        template <typename _Shape, typename _Visitor>
+        bool query(const _Shape& _Query, _Visitor&& _Func) const {
+            return nodes.empty() || query_shape(0, _Query, _Query.get_bounds(), _Func);
+        }
+
+        template <typename _Shape>
+        void query(const _Shape& _Query, std::vector<ObjectPtr>& _Objects) const {
+            auto append = [&](const ObjectPtr& _Object) { _Objects.push_back(_Object); };
+            query_shape(0, _Query, _Query.get_bounds(), append);
+        }
+    };
+
+#if defined(NC_QUADTREE_MMAP)
+    // read-only memory map of a whole file, for QuadTreeView
+    class QuadTreeMappedFile {
+        void* data = nullptr;
+        size_t size = 0;
+    public:
+        QuadTreeMappedFile() {}
+
+        // throws std::runtime_error if the file cannot be mapped
+        explicit QuadTreeMappedFile(const char* _Path) {
+            int file = ::open(_Path, O_RDONLY);
+
+            if (file < 0)
+                throw std::runtime_error("cannot open file");
+
+            struct stat status;
+
+            if (::fstat(file, &status) != 0 || status.st_size <= 0) {
+                ::close(file);
+                throw std::runtime_error("cannot map file");
+            }
+
+            size = static_cast<size_t>(status.st_size);
+            data = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, file, 0);
+            ::close(file);
+
+            if (data == MAP_FAILED) {
+                data = nullptr;
+                throw std::runtime_error("cannot map file");
+            }
+        }
+
+        QuadTreeMappedFile(const QuadTreeMappedFile&) = delete;
+        QuadTreeMappedFile& operator=(const QuadTreeMappedFile&) = delete;
+
+        ~QuadTreeMappedFile() {
+            if (data)
+                ::munmap(data, size);
+        }
+
+        const void* get_data() const { return data; }
+        size_t get_size() const { return size; }
+    };
+#endif
+
+    // single writer, many readers. the writer mutates its private tree
+    // and publish() swaps in an immutable copy of it. readers grab the
+    // current copy with snapshot() and query it without any locking, a
+    // snapshot stays valid for as long as the reader holds on to it.
+    // the copy shares the node pages and the objects with the writer
+    // tree, publishing costs a page table copy plus the id index when it
+    // is enabled, and the writer clones a page the first time it changes
+    // it afterwards. objects reachable from a snapshot must not change,
+    // the writer tree copies an object on update instead of moving it
+    template <typename T = double, size_t _Capacity = 2>
+    class QuadTreeConcurrent {
+    public:
+        using Tree = QuadTree<T, _Capacity>;
+        using Snapshot = std::shared_ptr<const Tree>;
+        using ObjectPtr = typename Tree::ObjectPtr;
+        using Operation = typename Tree::Operation;
+
+        QuadTreeConcurrent() {
+            tree.set_copy_on_update(true);
+            publish();
+        }
+
+        QuadTreeConcurrent(const QuadTreeAABB<T>& _Bounds) : tree(_Bounds) {
+            tree.set_copy_on_update(true);
+            publish();
+        }
+
+        ~QuadTreeConcurrent() {}
+
+        // the writer side, only one thread may use it at a time. it runs
+        // with copy on update, so update() and apply() never write an
+        // object a snapshot can see. published objects must not be
+        // written by hand either
+        Tree& writer() { return tree; }
+
+        // writer side mutations, seen by readers after the next publish()
+        bool insert(const ObjectPtr& _Object) { return tree.insert(_Object); }
+        bool remove(const ObjectPtr& _Object) { return tree.remove(_Object); }
+        bool remove(size_t _Id) { return tree.remove(_Id); }
+
+        // returns the copy that replaced _Object, null if the update failed
+        ObjectPtr update(const ObjectPtr& _Object, const QuadTreeAABB<T>& _Bounds) {
+            return tree.replace(_Object, _Bounds);
+        }
+
+        // Tree::apply(), the object of every successful update operation
+        // is set to the copy that replaced it
+        size_t apply(std::vector<Operation>& _Operations) {
+            std::vector<ObjectPtr> objects(_Operations.size());
+            size_t applied = tree.apply(_Operations.data(), _Operations.size(), objects.data());
+
+            for (size_t i = 0; i < _Operations.size(); i++) {
+                if (_Operations[i].type == Tree::OperationType::Update && objects[i])
+                    _Operations[i].object = objects[i];
+            }
+
+            return applied;
+        }
+
+        // makes the current state of the writer tree visible to readers
+        Snapshot publish() {
+            tree.commit();
+
+            Snapshot next = std::make_shared<const Tree>(tree);
+#if defined(__cpp_lib_atomic_shared_ptr)
+            current.store(next);
+#else
+            std::atomic_store(&current, next);
+#endif
+            return next;
+        }
+
+        Snapshot snapshot() const {
+#if defined(__cpp_lib_atomic_shared_ptr)
+            return current.load();
+#else
+            return std::atomic_load(&current);
+#endif
+        }
+    private:
+        Tree tree;
+#if defined(__cpp_lib_atomic_shared_ptr)
+        std::atomic<Snapshot> current;
+#else
+        Snapshot current;
+#endif
+    };
+
+    template<typename T, size_t _Capacity>
+    inline bool QuadTree<T, _Capacity>::can_split(NodeIndex _Node, size_t _Count) const
+    {
+        const Node& node = nodes[_Node];
+        const QuadTreeAABB<T>& b = node.bounds;
+
+        if (_Count <= split_capacity())
+            return false;
+
+        if (node.level >= policy.max_depth)
+            return false;
+
+        // the center has to fall strictly inside, otherwise the quadrants
+        // are empty once the coordinates run out of precision
+        const T x = b.center_x(), y = b.center_y();
+
+        if (!(b.left < x && x < b.right && b.top < y && y < b.bottom))
+            return false;
+
+        if (x - b.left < policy.min_size || b.right - x < policy.min_size ||
+            y - b.top < policy.min_size || b.bottom - y < policy.min_size)
+            return false;
+
+        return !policy.split || policy.split(b, node.level, _Count);
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::split(NodeIndex _Node)
+    {
+        if (!nodes[_Node].has_children()) {
+            // allocating may grow the pool, take references afterwards
+            NodeIndex first = nodes.allocate_block();
+            NC_QUADTREE_COUNT(splits, 1);
+            const Node& node = nodes[_Node];
+            const QuadTreeAABB<T>& b = node.bounds;
+            const T x = b.center_x(), y = b.center_y();
+
+            const QuadTreeAABB<T> quadrants[kChildren] = {
+                // top left
+                QuadTreeAABB<T>(b.left, b.top, x, y),
+                // top right
+                QuadTreeAABB<T>(x, b.top, b.right, y),
+                // bottom right
+                QuadTreeAABB<T>(x, y, b.right, b.bottom),
+                // bottom left
+                QuadTreeAABB<T>(b.left, y, x, b.bottom)
+            };
+
+            for (size_t i = 0; i < kChildren; i++) {
+                Node& child = nodes[first + i];
+                child.bounds = quadrants[i];
+                child.max_bounds = quadrants[i];
+                child.parent = _Node;
+                child.level = node.level + 1;
+            }
+
+            nodes[_Node].first_child = first;
+        }
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::merge(NodeIndex _Node)
+    {
+        NodeIndex first = nodes[_Node].first_child;
+
+        if (first != kNullNode) {
+            for (size_t i = 0; i < kChildren; i++)
+                merge(first + i);
+
+            nodes.free_block(first);
+            nodes[_Node].first_child = kNullNode;
+            NC_QUADTREE_COUNT(merges, 1);
+        }
+    }
+
+    template<typename T, size_t _Capacity>
+    inline bool QuadTree<T, _Capacity>::can_merge(NodeIndex _Node) const
+    {
+        const Node& node = nodes[_Node];
+
+        if (!node.has_children())
+            return false;
+
+        // empty children also go once the node itself has room again
+        return node.total_count <= merge_threshold() ||
+            (node.total_count == node.slot_count() && node.slot_count() < split_capacity());
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::pull_up(NodeIndex _Node)
+    {
+        NodeIndex first = nodes[_Node].first_child;
+
+        for (size_t i = 0; i < kChildren; i++)
+            pull_up(_Node, first + static_cast<NodeIndex>(i));
+
+        // the freed nodes are reset, which drops their references
+        merge(_Node);
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::pull_up(NodeIndex _Node, NodeIndex _From)
+    {
+        const Node& from = nodes[_From];
+
+        for (size_t i = 0; i < from.slot_count(); i++)
+            place(_Node, from.get_object(i));
+
+        if (from.has_children()) {
+            for (size_t i = 0; i < kChildren; i++)
+                pull_up(_Node, from.first_child + static_cast<NodeIndex>(i));
+        }
+    }
+
+    template<typename T, size_t _Capacity>
+    inline typename QuadTree<T, _Capacity>::NodeIndex QuadTree<T, _Capacity>::collapse(NodeIndex _Node)
+    {
+        NodeIndex top = _Node;
+        NodeIndex parent = nodes[top].parent;
+
+        while (parent != kNullNode && can_merge(parent)) {
+            top = parent;
+            parent = nodes[top].parent;
+        }
+
+        if (!can_merge(top))
+            return _Node;
+
+        if (merge_policy.delay == 0) {
+            pull_up(top);
+            return top;
+        }
+
+        // _Node stays until then
+        if (nodes[top].merge_tick == 0) {
+            nodes[top].merge_tick = ticks + 1;
+            pending_merges.push_back({ top, ticks + 1 });
+        }
+
+        return _Node;
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::add_total(NodeIndex _Node)
+    {
+        for (; _Node != kNullNode; _Node = nodes[_Node].parent) {
+            Node& node = nodes[_Node];
+
+            node.total_count++;
+
+            // a delayed merge starts over once the subtree fills up
+            if (node.merge_tick != 0 && !can_merge(_Node))
+                node.merge_tick = 0;
+        }
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::sub_total(NodeIndex _Node)
+    {
+        for (; _Node != kNullNode; _Node = nodes[_Node].parent)
+            nodes[_Node].total_count--;
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::fit_max_bounds(NodeIndex _Node)
+    {
+        Node& node = nodes[_Node];
+        QuadTreeAABB<T>& max_bounds = node.max_bounds;
+
+        NC_QUADTREE_COUNT(bound_updates, 1);
+        max_bounds = node.bounds;
+
+        for (size_t i = 0; i < node.slot_count(); i++) {
+            const QuadTreeAABB<T> object_bounds = node.get_object_bounds(i);
+
+            max_bounds.left = std::min(max_bounds.left, object_bounds.left);
+            max_bounds.top = std::min(max_bounds.top, object_bounds.top);
+            max_bounds.right = std::max(max_bounds.right, object_bounds.right);
+            max_bounds.bottom = std::max(max_bounds.bottom, object_bounds.bottom);
+
+            if (!max_bounds.verify()) {
+                throw std::logic_error("invalid bounds");
+            }
+        }
+
+        if (node.has_children()) {
+            for (size_t i = 0; i < kChildren; i++) {
+                const QuadTreeAABB<T>& child_bounds = nodes[node.first_child + i].max_bounds;
+
+                max_bounds.left = std::min(max_bounds.left, child_bounds.left);
+                max_bounds.top = std::min(max_bounds.top, child_bounds.top);
+                max_bounds.right = std::max(max_bounds.right, child_bounds.right);
+                max_bounds.bottom = std::max(max_bounds.bottom, child_bounds.bottom);
+
+                if (!max_bounds.verify()) {
+                    throw std::logic_error("invalid bounds");
+                }
+            }
+        }
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::resolve_max_bounds(NodeIndex _Node)
+    {
+        for (; _Node != kNullNode; _Node = nodes[_Node].parent)
+            fit_max_bounds(_Node);
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::expand_max_bounds(NodeIndex _Node, const QuadTreeAABB<T>& _Bounds)
+    {
+        // the bounds of a node always cover the ones of its children,
+        // so the walk can stop at the first node that already covers _Bounds
+        for (; _Node != kNullNode; _Node = nodes[_Node].parent) {
+            QuadTreeAABB<T>& max_bounds = nodes[_Node].max_bounds;
+
+            if (max_bounds.contains(_Bounds))
+                break;
+
+            NC_QUADTREE_COUNT(bound_updates, 1);
+            max_bounds.left = std::min(max_bounds.left, _Bounds.left);
+            max_bounds.top = std::min(max_bounds.top, _Bounds.top);
+            max_bounds.right = std::max(max_bounds.right, _Bounds.right);
+            max_bounds.bottom = std::max(max_bounds.bottom, _Bounds.bottom);
+        }
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::shrink_max_bounds(NodeIndex _Node)
+    {
+        if (deferred_bounds) {
+            for (; _Node != kNullNode && !nodes[_Node].dirty; _Node = nodes[_Node].parent)
+                nodes[_Node].dirty = true;
+
+            return;
+        }
+
+        for (; _Node != kNullNode; _Node = nodes[_Node].parent) {
+            const QuadTreeAABB<T> old_bounds = nodes[_Node].max_bounds;
+
+            fit_max_bounds(_Node);
+
+            if (nodes[_Node].max_bounds == old_bounds)
+                break;
+        }
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::commit(NodeIndex _Node)
+    {
+        Node& node = nodes[_Node];
+
+        if (!node.dirty)
+            return;
+
+        if (node.has_children()) {
+            for (size_t i = 0; i < kChildren; i++)
+                commit(node.first_child + i);
+        }
+
+        fit_max_bounds(_Node);
+        node.dirty = false;
+    }
+
+    template<typename T, size_t _Capacity>
+    inline bool QuadTree<T, _Capacity>::compact(NodeIndex _Node)
+    {
+        Node& node = nodes[_Node];
+
+        if (!node.has_children())
+            return false;
+
+        if (can_merge(_Node)) {
+            pull_up(_Node);
+            nodes[_Node].dirty = true;
+            return true;
+        }
+
+        bool changed = false;
+
+        for (size_t i = 0; i < kChildren; i++)
+            changed |= compact(node.first_child + static_cast<NodeIndex>(i));
+
+        if (changed)
+            nodes[_Node].dirty = true;
+
+        return changed;
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::adopt(NodeIndex _Node)
+    {
+        const Node& node = nodes[_Node];
+
+        if (node.has_children()) {
+            for (size_t i = 0; i < kChildren; i++)
+                nodes[node.first_child + i].parent = _Node;
+        }
+
+        if (index_enabled) {
+            for (size_t i = 0; i < node.slot_count(); i++)
+                index_set(node.get_object(i)->id, _Node, i);
+        }
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::relevel(NodeIndex _Node, size_t _Level)
+    {
+        Node& node = nodes[_Node];
+
+        node.level = _Level;
+
+        if (node.has_children()) {
+            for (size_t i = 0; i < kChildren; i++)
+                relevel(node.first_child + static_cast<NodeIndex>(i), _Level + 1);
+        }
+    }
+
+    template<typename T, size_t _Capacity>
+    inline bool QuadTree<T, _Capacity>::grow(const QuadTreeAABB<T>& _Bounds)
+    {
+        const T lowest = std::numeric_limits<T>::lowest();
+        const T highest = std::numeric_limits<T>::max();
+
+        while (!nodes[root].bounds.contains(_Bounds)) {
+            const QuadTreeAABB<T> b = nodes[root].bounds;
+
+            // the size itself has to fit before it can be doubled
+            if ((b.left < T() && b.right > highest + b.left) || (b.top < T() && b.bottom > highest + b.top))
+                return false;
+
+            const T width = b.width(), height = b.height();
+
+            if (!(width > T()) || !(height > T()))
+                return false;
+
+            // towards the side _Bounds sticks out of the most, the old root
+            // takes the opposite quadrant
+            const bool left = b.left - _Bounds.left > _Bounds.right - b.right;
+            const bool up = b.top - _Bounds.top > _Bounds.bottom - b.bottom;
+
+            if ((left ? b.left < lowest + width : b.right > highest - width) ||
+                (up ? b.top < lowest + height : b.bottom > highest - height))
+                return false;
+
+            const QuadTreeAABB<T> grown(left ? b.left - width : b.left, up ? b.top - height : b.top,
+                left ? b.right : b.right + width, up ? b.bottom : b.bottom + height);
+
+            // top left, top right, bottom right, bottom left
+            const size_t quadrant = up ? (left ? 2 : 3) : (left ? 1 : 0);
+
+            // allocating may grow the pool, take references afterwards
+            NodeIndex first = nodes.allocate_block();
+            NodeIndex moved = first + static_cast<NodeIndex>(quadrant);
+
+            version++;
+            nodes[moved] = std::move(nodes[root]);
+            nodes[root] = Node();
+
+            Node& old = nodes[moved];
+            Node& top = nodes[root];
+
+            old.parent = root;
+            old.merge_tick = 0;
+            adopt(moved);
+
+            top.bounds = grown;
+            top.max_bounds = QuadTreeAABB<T>(std::min(grown.left, old.max_bounds.left),
+                std::min(grown.top, old.max_bounds.top), std::max(grown.right, old.max_bounds.right),
+                std::max(grown.bottom, old.max_bounds.bottom));
+            top.first_child = first;
+            top.total_count = old.total_count;
+            top.dirty = old.dirty;
+
+            const T x = grown.center_x(), y = grown.center_y();
+            const QuadTreeAABB<T> quadrants[kChildren] = {
+                QuadTreeAABB<T>(grown.left, grown.top, x, y),
+                QuadTreeAABB<T>(x, grown.top, grown.right, y),
+                QuadTreeAABB<T>(x, y, grown.right, grown.bottom),
+                QuadTreeAABB<T>(grown.left, y, x, grown.bottom)
+            };
+
+            for (size_t i = 0; i < kChildren; i++) {
+                if (i == quadrant)
+                    continue;
+
+                Node& child = nodes[first + i];
+                child.bounds = quadrants[i];
+                child.max_bounds = quadrants[i];
+                child.parent = root;
+            }
+
+            relevel(root, 1);
+
+            // objects the old root held without containing them belong to
+            // the root under contained placement
+            if (placement == QuadTreePlacement::Contained) {
+                bool moved_up = false;
+
+                for (size_t i = nodes[moved].slot_count(); i-- > 0;) {
+                    if (nodes[moved].bounds.contains(nodes[moved].get_object_bounds(i)))
+                        continue;
+
+                    ObjectPtr object = nodes[moved].get_object(i);
+
+                    place(root, object);
+                    take(moved, i);
+                    nodes[moved].total_count--;
+                    moved_up = true;
+                }
+
+                if (moved_up)
+                    fit_max_bounds(moved);
+            }
+        }
+
+        return true;
+    }
+
+    template<typename T, size_t _Capacity>
+    inline size_t QuadTree<T, _Capacity>::shrink()
+    {
+        size_t removed = 0;
+
+        while (nodes[root].has_children() && nodes[root].slot_count() == 0) {
+            NodeIndex first = nodes[root].first_child;
+            NodeIndex only = kNullNode;
+            size_t occupied = 0;
+
+            for (size_t i = 0; i < kChildren; i++) {
+                if (nodes[first + i].total_count > 0) {
+                    only = first + static_cast<NodeIndex>(i);
+                    occupied++;
+                }
+            }
+
+            if (occupied != 1)
+                break;
+
+            for (size_t i = 0; i < kChildren; i++) {
+                if (first + i != only)
+                    merge(first + static_cast<NodeIndex>(i));
+            }
+
+            version++;
+            nodes[root] = std::move(nodes[only]);
+            nodes[root].parent = kNullNode;
+            nodes[root].merge_tick = 0;
+            adopt(root);
+
+            nodes.free_block(first);
+            relevel(root, 1);
+            removed++;
+        }
+
+        return removed;
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::tick()
+    {
+        ticks++;
+
+        size_t kept = 0;
+
+        for (size_t i = 0; i < pending_merges.size(); i++) {
+            NodeIndex node = pending_merges[i].first;
+
+            // merged since, freed nodes are reset
+            if (nodes[node].merge_tick != pending_merges[i].second)
+                continue;
+
+            // filled up again before the delay ran out
+            if (!can_merge(node)) {
+                nodes[node].merge_tick = 0;
+                continue;
+            }
+
+            if (ticks - pending_merges[i].second + 1 < merge_policy.delay) {
+                pending_merges[kept++] = pending_merges[i];
+                continue;
+            }
+
+            nodes[node].merge_tick = 0;
+            pull_up(node);
+            shrink_max_bounds(node);
+        }
+
+        pending_merges.resize(kept);
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::compact()
+    {
+        // merged entries of pending_merges go stale on their own
+        bool changed = compact(root);
+
+        if (grow_enabled)
+            changed |= shrink() > 0;
+
+        if (changed && !deferred_bounds)
+            commit();
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::begin_batch()
+    {
+        if (batching)
+            throw std::logic_error("batch already started");
+
+        batching = true;
+        batch_deferred_bounds = deferred_bounds;
+        deferred_bounds = true;
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::end_batch()
+    {
+        if (!batching)
+            throw std::logic_error("no batch started");
+
+        compact(root);
+
+        batching = false;
+        deferred_bounds = batch_deferred_bounds;
+
+        if (!deferred_bounds)
+            commit();
+    }
+
+    template<typename T, size_t _Capacity>
+    inline size_t QuadTree<T, _Capacity>::apply(const Operation* _Operations, size_t _Count, ObjectPtr* _Objects)
+    {
+        const QuadTreeAABB<T>& space = nodes[root].bounds;
+
+        // every operation takes the key of the first operation on its
+        // object, the stable sort then keeps those in their order
+        std::unordered_map<const Object*, uint64_t> keys;
+        std::vector<std::pair<uint64_t, size_t>> order;
+
+        order.reserve(_Count);
+
+        for (size_t i = 0; i < _Count; i++) {
+            const Operation& operation = _Operations[i];
+
+            if (_Objects)
+                _Objects[i] = ObjectPtr();
+
+            // null objects are skipped and count as failed, as in build()
+            if (!operation.object)
+                continue;
+
+            const QuadTreeAABB<T>& target = operation.type == OperationType::Update
+                ? operation.bounds : operation.object->bounds;
+
+            auto key = keys.insert({ operation.object.get(), morton::encode(space, target) });
+            order.push_back({ key.first->second, i });
+        }
+
+        std::stable_sort(order.begin(), order.end(),
+            [](const std::pair<uint64_t, size_t>& _A, const std::pair<uint64_t, size_t>& _B) {
+                return _A.first < _B.first;
+            });
+
+        bool own_batch = !batching;
+
+        if (own_batch)
+            begin_batch();
+
+        size_t applied = 0;
+
+        // with copy on update, the copies that replaced the objects
+        std::unordered_map<const Object*, ObjectPtr> copies;
+
+        // a throwing insert must not leave the batch open
+        try {
+            for (const std::pair<uint64_t, size_t>& entry : order) {
+                const Operation& operation = _Operations[entry.second];
+                ObjectPtr object = operation.object;
+                bool done = false;
+
+                if (copy_on_update) {
+                    auto copy = copies.find(operation.object.get());
+
+                    if (copy != copies.end())
+                        object = copy->second;
+                }
+
+                switch (operation.type) {
+                case OperationType::Insert:
+                    done = insert(object);
+                    break;
+                case OperationType::Remove:
+                    done = remove(object);
+                    break;
+                case OperationType::Update:
+                    if (copy_on_update) {
+                        ObjectPtr moved = replace(object, operation.bounds);
+
+                        if (moved)
+                            copies[operation.object.get()] = object = moved;
+
+                        done = static_cast<bool>(moved);
+                    }
+                    else {
+                        done = update(object, operation.bounds);
+                    }
+                    break;
+                }
+
+                applied += done;
+
+                if (_Objects && done)
+                    _Objects[entry.second] = object;
+            }
+        }
+        catch (...) {
+            if (own_batch)
+                end_batch();
+
+            throw;
+        }
+
+        if (own_batch)
+            end_batch();
+
+        return applied;
+    }
+
+    template<typename T, size_t _Capacity>
+    template<typename _Iterator>
+    inline size_t QuadTree<T, _Capacity>::build(_Iterator _Begin, _Iterator _End, size_t _Threads)
+    {
+        const QuadTreeAABB<T> root_bounds = nodes[root].bounds;
+
+        version++;
+        nodes.clear();
+        index.clear();
+        pending_merges.clear();
+        root = nodes.allocate();
+        set_bounds(root_bounds);
+
+        std::vector<BuildItem> items;
+
+        for (; _Begin != _End; ++_Begin) {
+            const ObjectPtr& object = *_Begin;
+
+            if (object && (grow_enabled || root_bounds.intersects(object->bounds)))
+                items.push_back({ 0, object->bounds, object });
+        }
+
+        if (grow_enabled && !items.empty()) {
+            QuadTreeAABB<T> extent = items.front().bounds;
+
+            for (const BuildItem& item : items) {
+                extent.left = std::min(extent.left, item.bounds.left);
+                extent.top = std::min(extent.top, item.bounds.top);
+                extent.right = std::max(extent.right, item.bounds.right);
+                extent.bottom = std::max(extent.bottom, item.bounds.bottom);
+            }
+
+            grow(extent);
+
+            const QuadTreeAABB<T>& space = nodes[root].bounds;
+
+            items.erase(std::remove_if(items.begin(), items.end(),
+                [&](const BuildItem& _Item) { return !space.intersects(_Item.bounds); }), items.end());
+        }
+
+        for (BuildItem& item : items)
+            item.code = morton::encode(nodes[root].bounds, item.bounds);
+
+        if (_Threads == 0)
+            _Threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+        if (items.size() < kParallelBuildGrain * 2)
+            _Threads = 1;
+
+        sort_items(items, _Threads);
+
+        nodes.reserve(1 + (items.size() / _Capacity + 1) * 2);
+
+        // objects the z-order partition could not place, either because
+        // they do not touch the quadrant their center falls into or
+        // because they share a key deeper than the key resolution
+        std::vector<ObjectPtr> deferred;
+
+        if (_Threads > 1)
+            build_parallel(items.data(), items.data() + items.size(), _Threads, deferred);
+        else
+            build(root, items.data(), items.data() + items.size(), 62, deferred);
+
+        for (const ObjectPtr& object : deferred)
+            insert(root, object);
+
+        return items.size();
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::build(NodeIndex _Node, BuildItem* _First, BuildItem* _Last,
+        int _Shift, std::vector<ObjectPtr>& _Deferred)
+    {
+        size_t count = static_cast<size_t>(_Last - _First);
+
+        bool keep = !can_split(_Node, count);
+
+        if (keep || _Shift < 0) {
+            Node& node = nodes[_Node];
+
+            // past the key resolution the rest is inserted one by one
+            for (; _First != _Last && (node.object_count < _Capacity || keep); ++_First) {
+                place(_Node, _First->object);
+                _First->object.reset();
+            }
+
+            for (; _First != _Last; ++_First)
+                _Deferred.push_back(std::move(_First->object));
+
+            node.total_count = node.slot_count();
+            fit_max_bounds(_Node);
+            return;
+        }
+
+        BuildItem* begins[kChildren];
+        BuildItem* ends[kChildren];
+
+        partition(_Node, _First, _Last, _Shift, _Deferred, begins, ends);
+
+        for (size_t i = 0; i < kChildren; i++) {
+            NodeIndex child = nodes[_Node].first_child + static_cast<NodeIndex>(i);
+
+            build(child, begins[i], ends[i], _Shift - 2, _Deferred);
+            nodes[_Node].total_count += nodes[child].total_count;
+        }
+
+        fit_max_bounds(_Node);
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::partition(NodeIndex _Node, BuildItem* _First, BuildItem* _Last,
+        int _Shift, std::vector<ObjectPtr>& _Deferred, BuildItem** _Begins, BuildItem** _Ends)
+    {
+        // z-order digit to child index, children go tl, tr, br, bl
+        static constexpr size_t kMortonChild[kChildren] = { 0, 1, 3, 2 };
+
+        split(_Node);
+
+        NodeIndex first_child = nodes[_Node].first_child;
+        BuildItem* begin = _First;
+
+        for (size_t digit = 0; digit < kChildren; digit++) {
+            BuildItem* end = std::partition_point(begin, _Last,
+                [&](const BuildItem& _Item) { return ((_Item.code >> _Shift) & 3) <= digit; });
+
+            size_t child = kMortonChild[digit];
+            const QuadTreeAABB<T> child_bounds = nodes[first_child + child].bounds;
+            BuildItem* out = begin;
+
+            for (BuildItem* it = begin; it != end; ++it) {
+                bool fits = placement == QuadTreePlacement::Contained
+                    ? child_bounds.contains(it->bounds) && child_bounds.intersects(it->bounds)
+                    : child_bounds.intersects(it->bounds);
+
+                if (fits)
+                    *out++ = std::move(*it);
+                else
+                    _Deferred.push_back(std::move(it->object));
+            }
+
+            _Begins[child] = begin;
+            _Ends[child] = out;
+            begin = end;
+        }
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::build_parallel(BuildItem* _First, BuildItem* _Last,
+        size_t _Threads, std::vector<ObjectPtr>& _Deferred)
+    {
+        // split the top levels serially until there are a few tasks per thread
+        size_t depth = 1;
+
+        while ((size_t(1) << (2 * depth)) < _Threads * 4 && depth < 8)
+            depth++;
+
+        std::vector<BuildTask> tasks;
+        std::vector<NodeIndex> inner;
+
+        partition_tasks(root, _First, _Last, 62, depth, tasks, inner, _Deferred);
+
+        // the nodes are only read while the subtrees are built
+        run_parallel(tasks.size(), _Threads, [&](size_t _Task, size_t) {
+            BuildTask& task = tasks[_Task];
+            const Node& node = nodes[task.node];
+
+            task.subtree.reset(new QuadTree(node.bounds, policy));
+            task.subtree->placement = placement;
+            task.subtree->nodes[task.subtree->root].level = node.level;
+            task.subtree->build(task.subtree->root, task.first, task.last, task.shift, task.deferred);
+        });
+
+        for (BuildTask& task : tasks) {
+            graft(task);
+            _Deferred.insert(_Deferred.end(), task.deferred.begin(), task.deferred.end());
+        }
+
+        // inner nodes were recorded top down, children come after parents
+        for (auto it = inner.rbegin(); it != inner.rend(); ++it) {
+            Node& node = nodes[*it];
+
+            node.total_count = node.slot_count();
+
+            for (size_t i = 0; i < kChildren; i++)
+                node.total_count += nodes[node.first_child + i].total_count;
+
+            fit_max_bounds(*it);
+        }
+
+        if (index_enabled) {
+            index.clear();
+            index_rebuild(root);
+        }
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::partition_tasks(NodeIndex _Node, BuildItem* _First, BuildItem* _Last,
+        int _Shift, size_t _Depth, std::vector<BuildTask>& _Tasks, std::vector<NodeIndex>& _Inner,
+        std::vector<ObjectPtr>& _Deferred)
+    {
+        size_t count = static_cast<size_t>(_Last - _First);
+
+        if (_Depth == 0 || count <= kParallelBuildGrain || _Shift < 0 || !can_split(_Node, count)) {
+            BuildTask task;
+
+            task.node = _Node;
+            task.first = _First;
+            task.last = _Last;
+            task.shift = _Shift;
+
+            _Tasks.push_back(std::move(task));
+            return;
+        }
+
+        BuildItem* begins[kChildren];
+        BuildItem* ends[kChildren];
+
+        partition(_Node, _First, _Last, _Shift, _Deferred, begins, ends);
+        _Inner.push_back(_Node);
+
+        for (size_t i = 0; i < kChildren; i++) {
+            partition_tasks(nodes[_Node].first_child + static_cast<NodeIndex>(i),
+                begins[i], ends[i], _Shift - 2, _Depth - 1, _Tasks, _Inner, _Deferred);
+        }
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::graft(BuildTask& _Task)
+    {
+        QuadTreeNodePool<Node>& source = _Task.subtree->nodes;
+        NodeIndex source_root = _Task.subtree->root;
+
+        // a freshly built tree has its root at 0 followed by whole blocks
+        NodeIndex base = source.size() > 1 ? nodes.extend(source.size() - 1) : kNullNode;
+
+        auto remap = [&](NodeIndex _Index) {
+            return _Index == source_root ? _Task.node : base + (_Index - 1);
+        };
+
+        for (NodeIndex i = 0; i < source.size(); i++) {
+            Node& node = source[i];
+
+            if (node.first_child != kNullNode)
+                node.first_child = remap(node.first_child);
+
+            if (i == source_root) {
+                node.parent = nodes[_Task.node].parent;
+                nodes[_Task.node] = std::move(node);
+            }
+            else {
+                node.parent = remap(node.parent);
+                nodes[remap(i)] = std::move(node);
+            }
+        }
+
+        _Task.subtree.reset();
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::sort_items(std::vector<BuildItem>& _Items, size_t _Threads)
+    {
+        auto less = [](const BuildItem& _A, const BuildItem& _B) { return _A.code < _B.code; };
+
+        if (_Threads < 2) {
+            std::sort(_Items.begin(), _Items.end(), less);
+            return;
+        }
+
+        // sort one chunk per thread, then merge neighbouring runs pairwise
+        std::vector<size_t> runs(_Threads + 1);
+
+        for (size_t i = 0; i <= _Threads; i++)
+            runs[i] = _Items.size() * i / _Threads;
+
+        run_parallel(_Threads, _Threads, [&](size_t _Run, size_t) {
+            std::sort(_Items.begin() + runs[_Run], _Items.begin() + runs[_Run + 1], less);
+        });
+
+        for (size_t width = 1; width < _Threads; width *= 2) {
+            size_t merges = (_Threads + width * 2 - 1) / (width * 2);
+
+            run_parallel(merges, _Threads, [&](size_t _Merge, size_t) {
+                size_t first = _Merge * width * 2;
+                size_t middle = std::min(first + width, _Threads);
+                size_t last = std::min(first + width * 2, _Threads);
+
+                if (middle < last) {
+                    std::inplace_merge(_Items.begin() + runs[first], _Items.begin() + runs[middle],
+                        _Items.begin() + runs[last], less);
+                }
+            });
+        }
+    }
+
+    template<typename T, size_t _Capacity>
+    template<typename _Func>
+    inline void QuadTree<T, _Capacity>::run_parallel(size_t _Count, size_t _Threads, _Func&& _Task)
+    {
+        QuadTreeWorkers::get().run(_Count, _Threads, std::forward<_Func>(_Task));
+    }
+
+    template<typename T, size_t _Capacity>
+    inline bool QuadTree<T, _Capacity>::insert(NodeIndex _Node, const ObjectPtr& _Object)
+    {
+        if (placement == QuadTreePlacement::Contained)
+            return insert_contained(_Node, _Object);
+
+        if (nodes[_Node].bounds.intersects(_Object->bounds)) {
+            size_t count = nodes[_Node].slot_count();
+
+            if (count >= split_capacity() && (nodes[_Node].has_children() || can_split(_Node, count + 1))) {
+                split(_Node);
+
+                NodeIndex first = nodes[_Node].first_child;
+
+                if (insert(first + 0, _Object)
+                    || insert(first + 1, _Object)
+                    || insert(first + 2, _Object)
+                    || insert(first + 3, _Object))
+                    return true;
+            }
+
+            // below the capacity, or no child overlaps it: a box without
+            // area on a split line stays here, in the overflow list once
+            // the inline slots are full
+            place(_Node, _Object);
+
+            add_total(_Node);
+            expand_max_bounds(_Node, _Object->bounds);
+            return true;
+        }
+
+        return false;
+    }
+
+    template<typename T, size_t _Capacity>
+    inline bool QuadTree<T, _Capacity>::insert_contained(NodeIndex _Node, const ObjectPtr& _Object)
+    {
+        const QuadTreeAABB<T>& bounds = _Object->bounds;
+
+        if (!nodes[_Node].bounds.intersects(bounds))
+            return false;
+
+        for (;;) {
+            size_t count = nodes[_Node].slot_count();
+
+            if (!nodes[_Node].has_children() && count >= split_capacity() && can_split(_Node, count + 1)) {
+                split(_Node);
+                push_down(_Node);
+            }
+
+            NodeIndex child = containing_child(_Node, bounds);
+
+            if (child == kNullNode)
+                break;
+
+            _Node = child;
+        }
+
+        place(_Node, _Object);
+
+        add_total(_Node);
+        expand_max_bounds(_Node, bounds);
+        return true;
+    }
+
+    template<typename T, size_t _Capacity>
+    inline typename QuadTree<T, _Capacity>::NodeIndex QuadTree<T, _Capacity>::containing_child(
+        NodeIndex _Node, const QuadTreeAABB<T>& _Bounds) const
+    {
+        const Node& node = nodes[_Node];
+
+        if (node.has_children()) {
+            for (size_t i = 0; i < kChildren; i++) {
+                NodeIndex child = node.first_child + static_cast<NodeIndex>(i);
+
+                // a box without area on the edge of a child stays above it,
+                // searches along the box prune the child
+                if (nodes[child].bounds.contains(_Bounds) && nodes[child].bounds.intersects(_Bounds))
+                    return child;
+            }
+        }
+
+        return kNullNode;
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::push_down(NodeIndex _Node)
+    {
+        // backwards, take() moves the last slot into the hole
+        for (size_t i = nodes[_Node].slot_count(); i-- > 0;) {
+            NodeIndex child = containing_child(_Node, nodes[_Node].get_object_bounds(i));
+
+            if (child == kNullNode)
+                continue;
+
+            // the totals above the children already count the object
+            ObjectPtr object = nodes[_Node].get_object(i);
+
+            place(child, object);
+            nodes[child].total_count++;
+            take(_Node, i);
+        }
+
+        NodeIndex first = nodes[_Node].first_child;
+
+        for (size_t i = 0; i < kChildren; i++)
+            fit_max_bounds(first + static_cast<NodeIndex>(i));
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::index_set(size_t _Id, NodeIndex _Node, size_t _Slot)
+    {
+        if (_Id >= index.size())
+            index.resize(std::max(_Id + 1, index.size() * 2));
+
+        index[_Id].node = _Node;
+        index[_Id].slot = static_cast<uint32_t>(_Slot);
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::index_rebuild(NodeIndex _Node)
+    {
+        const Node& node = nodes[_Node];
+
+        for (size_t i = 0; i < node.slot_count(); i++)
+            index_set(node.get_object(i)->id, _Node, i);
+
+        if (node.has_children()) {
+            for (size_t i = 0; i < kChildren; i++)
+                index_rebuild(node.first_child + i);
+        }
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::set_index_enabled(bool _Enabled)
+    {
+        index.clear();
+        index_enabled = _Enabled;
+
+        if (_Enabled)
+            index_rebuild(root);
+    }
+
+    template<typename T, size_t _Capacity>
+    inline bool QuadTree<T, _Capacity>::locate(size_t _Id, const QuadTreeAABB<T>* _Bounds,
+        NodeIndex& _Owner, size_t& _Slot) const
+    {
+        if (index_enabled) {
+            if (_Id >= index.size() || index[_Id].node == kNullNode)
+                return false;
+
+            _Owner = index[_Id].node;
+            _Slot = index[_Id].slot;
+            return true;
+        }
+
+        return locate(root, _Id, _Bounds, _Owner, _Slot);
+    }
+
+    template<typename T, size_t _Capacity>
+    inline bool QuadTree<T, _Capacity>::locate(NodeIndex _Node, size_t _Id, const QuadTreeAABB<T>* _Bounds,
+        NodeIndex& _Owner, size_t& _Slot) const
+    {
+        const Node& node = nodes[_Node];
+
+        if (!_Bounds || node.bounds.intersects(*_Bounds)) {
+            for (size_t i = 0; i < node.slot_count(); i++) {
+                if (node.get_object(i)->id == _Id) {
+                    _Owner = _Node;
+                    _Slot = i;
+                    return true;
+                }
+            }
+
+            if (node.has_children()) {
+                for (size_t i = 0; i < kChildren; i++) {
+                    if (locate(node.first_child + i, _Id, _Bounds, _Owner, _Slot))
+                        return true;
+                }
+            }
+        }
+
+        return false;
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::place(NodeIndex _Node, const ObjectPtr& _Object)
+    {
+        Node& node = nodes[_Node];
+
+        version++;
+
+        if (index_enabled)
+            index_set(_Object->id, _Node, node.slot_count());
+
+        if (node.object_count < _Capacity) {
+            node.object_bounds.set(node.object_count, _Object->bounds);
+            node.objects[node.object_count] = _Object;
+            node.object_count++;
+        }
+        else {
+            node.overflow.push_back({ _Object->bounds, _Object });
+        }
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::take(NodeIndex _Node, size_t _Slot)
+    {
+        Node& node = nodes[_Node];
+
+        version++;
+
+        // keep the occupied slots packed at the front, the last overflow
+        // slot moves into the inline slots first
+        size_t last = node.slot_count() - 1;
+
+        if (index_enabled) {
+            IndexEntry& entry = index[node.get_object(_Slot)->id];
+
+            // update() inserts the new copy first, keep that entry
+            if (entry.node == _Node && entry.slot == _Slot)
+                entry.node = kNullNode;
+
+            if (_Slot != last)
+                index_set(node.get_object(last)->id, _Node, _Slot);
+        }
+
+        if (last < _Capacity) {
+            node.object_bounds.copy(_Slot, last);
+            node.objects[_Slot] = std::move(node.objects[last]);
+            node.objects[last].reset();
+            node.object_count--;
+        }
+        else {
+            OverflowSlot& tail = node.overflow.back();
+
+            if (_Slot < _Capacity) {
+                node.object_bounds.set(_Slot, tail.bounds);
+                node.objects[_Slot] = std::move(tail.object);
+            }
+            else if (_Slot != last) {
+                node.overflow[_Slot - _Capacity] = std::move(tail);
+            }
+
+            node.overflow.pop_back();
+        }
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::erase(NodeIndex _Node, size_t _Slot)
+    {
+        take(_Node, _Slot);
+
+        sub_total(_Node);
+        if (!batching)
+            _Node = collapse(_Node);
+
+        shrink_max_bounds(_Node);
+    }
+
+    template<typename T, size_t _Capacity>
+    inline bool QuadTree<T, _Capacity>::remove(const ObjectPtr& _Object)
+    {
+        NodeIndex owner;
+        size_t slot;
+
+        if (!locate(_Object->id, &_Object->bounds, owner, slot))
+            return false;
+
+        erase(owner, slot);
+        return true;
+    }
+
+    template<typename T, size_t _Capacity>
+    inline bool QuadTree<T, _Capacity>::remove(size_t _Id)
+    {
+        NodeIndex owner;
+        size_t slot;
+
+        if (!locate(_Id, nullptr, owner, slot))
+            return false;
+
+        erase(owner, slot);
+        return true;
+    }
+
+    template<typename T, size_t _Capacity>
+    inline typename QuadTree<T, _Capacity>::ObjectPtr QuadTree<T, _Capacity>::find(size_t _Id) const
+    {
+        NodeIndex owner;
+        size_t slot;
+
+        if (!locate(_Id, nullptr, owner, slot))
+            return ObjectPtr();
+
+        return nodes[owner].get_object(slot);
+    }
+
+    template<typename T, size_t _Capacity>
+    inline bool QuadTree<T, _Capacity>::update(const ObjectPtr& _Object, const QuadTreeAABB<T>& _Bounds)
+    {
+        if (copy_on_update)
+            return static_cast<bool>(replace(_Object, _Bounds));
+
+        return move(_Object, _Object, _Bounds);
+    }
+
+    template<typename T, size_t _Capacity>
+    inline typename QuadTree<T, _Capacity>::ObjectPtr QuadTree<T, _Capacity>::replace(const ObjectPtr& _Object,
+        const QuadTreeAABB<T>& _Bounds)
+    {
+        ObjectPtr moved = std::make_shared<QuadTreeObject<T>>(*_Object);
+
+        if (!move(_Object, moved, _Bounds))
+            return ObjectPtr();
+
+        return moved;
+    }
+
+    template<typename T, size_t _Capacity>
+    inline bool QuadTree<T, _Capacity>::move(const ObjectPtr& _Object, const ObjectPtr& _Moved,
+        const QuadTreeAABB<T>& _Bounds)
+    {
+        NodeIndex owner;
+        size_t slot;
+
+        if (grow_enabled)
+            grow(_Bounds);
+
+        if (!nodes[root].bounds.intersects(_Bounds) ||
+            !locate(_Object->id, &_Object->bounds, owner, slot))
+            return false;
+
+        const QuadTreeAABB<T> old_bounds = _Object->bounds;
+        _Moved->bounds = _Bounds;
+
+        // still touches its node, only the slot and the loose bounds
+        // change. contained placement keeps the object only while the node
+        // still contains it
+        bool stays = placement == QuadTreePlacement::Contained
+            ? owner == root || (nodes[owner].bounds.contains(_Bounds) && nodes[owner].bounds.intersects(_Bounds))
+            : nodes[owner].bounds.intersects(_Bounds);
+
+        if (stays) {
+            version++;
+            nodes[owner].set_object(slot, _Moved);
+            nodes[owner].set_object_bounds(slot, _Bounds);
+            expand_max_bounds(owner, _Bounds);
+
+            if (!_Bounds.contains(old_bounds))
+                shrink_max_bounds(owner);
+
+            return true;
+        }
+
+        // climb to the closest ancestor that still holds the object. a box
+        // without area on the edge of an ancestor is contained but does
+        // not overlap it, insert() would turn it away
+        NodeIndex ancestor = nodes[owner].parent;
+
+        while (ancestor != root && !(nodes[ancestor].bounds.contains(_Bounds)
+            && nodes[ancestor].bounds.intersects(_Bounds)))
+            ancestor = nodes[ancestor].parent;
+
+        // insert before erasing so the empty node collapse in erase()
+        // cannot reach past the new owner, inserting never moves slots
+        // of the old owner since the insert never reaches it
+        ObjectPtr object = _Moved;
+        bool inserted = insert(ancestor, object);
+
+        erase(owner, slot);
+        return inserted;
+    }
+
+    template<typename T, size_t _Capacity>
+    template<typename _Visitor>
+    inline bool QuadTree<T, _Capacity>::query(NodeIndex _Node, const QuadTreeAABB<T>& _Bounds,
+        _Visitor& _Func, bool _BoundChecks) const
+    {
+        const Node& node = nodes[_Node];
+
+        if (node.max_bounds.intersects(_Bounds) || !_BoundChecks) {
+            NC_QUADTREE_COUNT(nodes_visited, 1);
+            NC_QUADTREE_COUNT(slot_tests, node.slot_count());
+
+            if (node.has_children()) {
+                for (size_t i = 0; i < kChildren; i++) {
+                    if (!query(node.first_child + i, _Bounds, _Func, _BoundChecks))
+                        return false;
+                }
+            }
+
+            uint32_t hits[_Capacity];
+            size_t hit_count = query_batch(_Bounds, node.object_bounds, node.object_count, hits);
+
+            for (size_t i = 0; i < hit_count; i++) {
+                NC_QUADTREE_COUNT(hits, 1);
+
+                if (!call_visitor(_Func, node.objects[hits[i]]))
+                    return false;
+            }
+
+            for (const OverflowSlot& slot : node.overflow) {
+                if (slot.bounds.intersects(_Bounds)) {
+                    NC_QUADTREE_COUNT(hits, 1);
+
+                    if (!call_visitor(_Func, slot.object))
+                        return false;
+                }
+            }
+        }
+        else {
+            NC_QUADTREE_COUNT(nodes_pruned, 1);
+        }
+
+        return true;
+    }
+
+    template<typename T, size_t _Capacity>
+    inline QuadTree<T, _Capacity>::QueryCursor::QueryCursor(const QuadTree* _Tree, const QuadTreeAABB<T>& _Bounds)
+        : tree(_Tree), bounds(_Bounds), version(_Tree->version)
+    {
+        stack.push_back(_Tree->root);
+    }
+
+    template<typename T, size_t _Capacity>
+    template<typename _Visitor>
+    inline size_t QuadTree<T, _Capacity>::QueryCursor::next(_Visitor&& _Func, size_t _Max)
+    {
+        return run(_Func, _Max, nullptr);
+    }
+
+    template<typename T, size_t _Capacity>
+    template<typename _Visitor>
+    inline size_t QuadTree<T, _Capacity>::QueryCursor::next(_Visitor&& _Func, size_t _Max, Clock::duration _Budget)
+    {
+        const Clock::time_point deadline = Clock::now() + _Budget;
+        return run(_Func, _Max, &deadline);
+    }
+
+    template<typename T, size_t _Capacity>
+    template<typename _Visitor>
+    inline size_t QuadTree<T, _Capacity>::QueryCursor::run(_Visitor& _Func, size_t _Max,
+        const Clock::time_point* _Deadline)
+    {
+        if (stale())
+            throw std::logic_error("quadtree changed since the query started");
+
+        size_t count = 0;
+        size_t visited = 0;
+
+        for (;;) {
+            if (node != kNullNode) {
+                const Node& current = tree->nodes[node];
+
+                while (hit < hit_count) {
+                    if (count == _Max)
+                        return count;
+
+                    NC_QUADTREE_COUNT(hits, 1);
+                    count++;
+
+                    if (!call_visitor(_Func, current.objects[hits[hit++]]))
+                        return count;
+                }
+
+                while (overflow < current.overflow.size()) {
+                    const OverflowSlot& slot = current.overflow[overflow];
+
+                    if (!slot.bounds.intersects(bounds)) {
+                        overflow++;
+                        continue;
+                    }
+
+                    if (count == _Max)
+                        return count;
+
+                    NC_QUADTREE_COUNT(hits, 1);
+                    overflow++;
+                    count++;
+
+                    if (!call_visitor(_Func, slot.object))
+                        return count;
+                }
+
+                node = kNullNode;
+            }
+
+            if (stack.empty())
+                return count;
+
+            if (_Deadline && ++visited % kClockInterval == 0 && Clock::now() >= *_Deadline)
+                return count;
+
+            NodeIndex index = stack.back();
+            const Node& next = tree->nodes[index];
+
+            stack.pop_back();
+
+            if (!next.max_bounds.intersects(bounds)) {
+                NC_QUADTREE_COUNT(nodes_pruned, 1);
+                continue;
+            }
+
+            NC_QUADTREE_COUNT(nodes_visited, 1);
+            NC_QUADTREE_COUNT(slot_tests, next.slot_count());
+
+            // backwards so the first child comes off the stack first
+            if (next.has_children()) {
+                for (size_t i = kChildren; i-- > 0;)
+                    stack.push_back(next.first_child + static_cast<NodeIndex>(i));
+            }
+
+            node = index;
+            hit_count = query_batch(bounds, next.object_bounds, next.object_count, hits.data());
+            hit = 0;
+            overflow = 0;
+        }
+    }
+
+    template<typename T, size_t _Capacity>
+    inline typename QuadTree<T, _Capacity>::Distance QuadTree<T, _Capacity>::distance_squared(
+        const QuadTreeAABB<T>& _Bounds, Distance _X, Distance _Y)
+    {
+        Distance dx = std::max(std::max(static_cast<Distance>(_Bounds.left) - _X, Distance(0)),
+            _X - static_cast<Distance>(_Bounds.right));
+        Distance dy = std::max(std::max(static_cast<Distance>(_Bounds.top) - _Y, Distance(0)),
+            _Y - static_cast<Distance>(_Bounds.bottom));
+
+        return dx * dx + dy * dy;
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::nearest(T _X, T _Y, size_t _Count,
+        std::vector<Neighbor>& _Neighbors, Distance _MaxDistance) const
+    {
+        _Neighbors.clear();
+
+        if (_Count == 0)
+            return;
+
+        const Distance x = static_cast<Distance>(_X);
+        const Distance y = static_cast<Distance>(_Y);
+        const Distance max_distance = _MaxDistance < std::sqrt(std::numeric_limits<Distance>::max())
+            ? _MaxDistance * _MaxDistance : std::numeric_limits<Distance>::max();
+
+        std::priority_queue<QueueEntry> queue;
+        Distance root_distance = distance_squared(nodes[root].max_bounds, x, y);
+
+        if (root_distance <= max_distance)
+            queue.push({ root_distance, root, kNodeEntry });
+
+        // an object popped off the queue is closer than everything left in
+        // it, so the first _Count objects popped are the answer
+        while (!queue.empty()) {
+            QueueEntry entry = queue.top();
+            queue.pop();
+
+            const Node& node = nodes[entry.node];
+
+            if (entry.slot != kNodeEntry) {
+                NC_QUADTREE_COUNT(hits, 1);
+                _Neighbors.push_back({ node.get_object(entry.slot), std::sqrt(entry.distance) });
+
+                if (_Neighbors.size() >= _Count)
+                    break;
+
+                continue;
+            }
+
+            NC_QUADTREE_COUNT(nodes_visited, 1);
+            NC_QUADTREE_COUNT(slot_tests, node.slot_count());
+
+            for (size_t i = 0; i < node.slot_count(); i++) {
+                Distance distance = distance_squared(node.get_object_bounds(i), x, y);
+
+                if (distance <= max_distance)
+                    queue.push({ distance, entry.node, static_cast<uint32_t>(i) });
+            }
+
+            if (node.has_children()) {
+                for (size_t i = 0; i < kChildren; i++) {
+                    NodeIndex child = node.first_child + static_cast<NodeIndex>(i);
+                    Distance distance = distance_squared(nodes[child].max_bounds, x, y);
+
+                    if (distance <= max_distance && nodes[child].total_count > 0)
+                        queue.push({ distance, child, kNodeEntry });
+                    else
+                        NC_QUADTREE_COUNT(nodes_pruned, 1);
+                }
+            }
+        }
+    }
+
+    template<typename T, size_t _Capacity>
+    inline bool QuadTree<T, _Capacity>::ray_entry(const QuadTreeAABB<T>& _Bounds, Distance _X, Distance _Y,
+        Distance _DirX, Distance _DirY, Distance _MaxT, Distance& _Entry)
+    {
+        Distance t_min = 0;
+        Distance t_max = _MaxT;
+
+        const Distance origin[2] = { _X, _Y };
+        const Distance direction[2] = { _DirX, _DirY };
+        const Distance low[2] = { static_cast<Distance>(_Bounds.left), static_cast<Distance>(_Bounds.top) };
+        const Distance high[2] = { static_cast<Distance>(_Bounds.right), static_cast<Distance>(_Bounds.bottom) };
+
+        for (size_t axis = 0; axis < 2; axis++) {
+            if (direction[axis] == 0) {
+                // parallel to the slab, either always inside or never
+                if (origin[axis] < low[axis] || origin[axis] > high[axis])
+                    return false;
+
+                continue;
+            }
+
+            Distance inverse = Distance(1) / direction[axis];
+            Distance t0 = (low[axis] - origin[axis]) * inverse;
+            Distance t1 = (high[axis] - origin[axis]) * inverse;
+
+            if (t0 > t1)
+                std::swap(t0, t1);
+
+            t_min = std::max(t_min, t0);
+            t_max = std::min(t_max, t1);
+
+            if (t_min > t_max)
+                return false;
+        }
+
+        _Entry = t_min;
+        return true;
+    }
+
+    template<typename T, size_t _Capacity>
+    template<typename _Visitor>
+    inline bool QuadTree<T, _Capacity>::raycast(Distance _X, Distance _Y, Distance _DirX, Distance _DirY,
+        Distance _MaxT, _Visitor&& _Func) const
+    {
+        std::priority_queue<QueueEntry> queue;
+        Distance entry_t;
+
+        if (ray_entry(nodes[root].max_bounds, _X, _Y, _DirX, _DirY, _MaxT, entry_t))
+            queue.push({ entry_t, root, kNodeEntry });
+
+        while (!queue.empty()) {
+            QueueEntry entry = queue.top();
+            queue.pop();
+
+            const Node& node = nodes[entry.node];
+
+            if (entry.slot != kNodeEntry) {
+                NC_QUADTREE_COUNT(hits, 1);
+
+                if (!call_visitor(_Func, node.get_object(entry.slot), entry.distance))
+                    return false;
+
+                continue;
+            }
+
+            NC_QUADTREE_COUNT(nodes_visited, 1);
+            NC_QUADTREE_COUNT(slot_tests, node.slot_count());
+
+            for (size_t i = 0; i < node.slot_count(); i++) {
+                if (ray_entry(node.get_object_bounds(i), _X, _Y, _DirX, _DirY, _MaxT, entry_t))
+                    queue.push({ entry_t, entry.node, static_cast<uint32_t>(i) });
+            }
+
+            if (node.has_children()) {
+                for (size_t i = 0; i < kChildren; i++) {
+                    NodeIndex child = node.first_child + static_cast<NodeIndex>(i);
+
+                    if (nodes[child].total_count > 0 &&
+                        ray_entry(nodes[child].max_bounds, _X, _Y, _DirX, _DirY, _MaxT, entry_t))
+                        queue.push({ entry_t, child, kNodeEntry });
+                    else
+                        NC_QUADTREE_COUNT(nodes_pruned, 1);
+                }
+            }
+        }
+
+        return true;
+    }
+
+    template<typename T, size_t _Capacity>
+    template<typename _Visitor>
+    inline bool QuadTree<T, _Capacity>::pairs_self(NodeIndex _Node, _Visitor& _Func) const
+    {
+        const Node& node = nodes[_Node];
+
+        if (node.total_count < 2)
+            return true;
+
+        for (size_t i = 0; i < node.slot_count(); i++) {
+            const QuadTreeAABB<T> bounds = node.get_object_bounds(i);
+            const ObjectPtr& object = node.get_object(i);
+
+            // the slots after i
+            uint32_t hits[_Capacity];
+            size_t hit_count = query_batch(bounds, node.object_bounds, node.object_count, hits);
+
+            for (size_t k = 0; k < hit_count; k++) {
+                if (hits[k] > i && !call_visitor(_Func, object, node.objects[hits[k]]))
+                    return false;
+            }
+
+            for (size_t k = i < _Capacity ? 0 : i - _Capacity + 1; k < node.overflow.size(); k++) {
+                if (node.overflow[k].bounds.intersects(bounds) &&
+                    !call_visitor(_Func, object, node.overflow[k].object))
+                    return false;
+            }
+
+            // everything below this node
+            if (node.has_children()) {
+                for (size_t c = 0; c < kChildren; c++) {
+                    if (!pairs_object(bounds, object, *this, node.first_child + c, false, _Func))
+                        return false;
+                }
+            }
+        }
+
+        if (node.has_children()) {
+            for (size_t i = 0; i < kChildren; i++) {
+                NodeIndex a = node.first_child + static_cast<NodeIndex>(i);
+
+                if (!pairs_self(a, _Func))
+                    return false;
+
+                for (size_t k = i + 1; k < kChildren; k++) {
+                    if (!pairs_cross(a, *this, node.first_child + static_cast<NodeIndex>(k), _Func))
+                        return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    template<typename T, size_t _Capacity>
+    template<typename _Other, typename _Visitor>
+    inline bool QuadTree<T, _Capacity>::pairs_cross(NodeIndex _Node, const _Other& _Tree,
+        typename _Other::NodeIndex _OtherNode, _Visitor& _Func) const
+    {
+        const Node& a = nodes[_Node];
+        const typename _Other::Node& b = _Tree.get_node(_OtherNode);
+
+        if (a.total_count < 1 || b.total_count < 1 || !a.max_bounds.intersects(b.max_bounds))
+            return true;
+
+        // slots of a against the whole subtree of b, including its slots
+        for (size_t i = 0; i < a.slot_count(); i++) {
+            if (!pairs_object(a.get_object_bounds(i), a.get_object(i), _Tree, _OtherNode, false, _Func))
+                return false;
+        }
+
+        if (a.has_children()) {
+            // slots of b against the children of a
+            for (size_t i = 0; i < b.slot_count(); i++) {
+                const QuadTreeAABB<T> bounds = b.get_object_bounds(i);
+
+                for (size_t c = 0; c < kChildren; c++) {
+                    if (!pairs_object(bounds, b.get_object(i), *this, a.first_child + c, true, _Func))
+                        return false;
+                }
+            }
+
+            // children against children
+            if (b.has_children()) {
+                for (size_t i = 0; i < kChildren; i++) {
+                    for (size_t k = 0; k < kChildren; k++) {
+                        if (!pairs_cross(a.first_child + static_cast<NodeIndex>(i), _Tree,
+                            b.first_child + static_cast<NodeIndex>(k), _Func))
+                            return false;
+                    }
+                }
+            }
+        }
+
+        return true;
+    }
+
+    template<typename T, size_t _Capacity>
+    template<typename _Other, typename _Visitor>
+    inline bool QuadTree<T, _Capacity>::pairs_object(const QuadTreeAABB<T>& _Bounds, const ObjectPtr& _Object,
+        const _Other& _Tree, typename _Other::NodeIndex _Node, bool _Swapped, _Visitor& _Func)
+    {
+        const typename _Other::Node& node = _Tree.get_node(_Node);
+
+        if (node.total_count < 1 || !node.max_bounds.intersects(_Bounds))
+            return true;
+
+        uint32_t hits[sizeof(node.objects) / sizeof(node.objects[0])];
+        size_t hit_count = query_batch(_Bounds, node.object_bounds, node.object_count, hits);
+
+        for (size_t i = 0; i < hit_count; i++) {
+            bool next = _Swapped
+                ? call_visitor(_Func, node.objects[hits[i]], _Object)
+                : call_visitor(_Func, _Object, node.objects[hits[i]]);
+
+            if (!next)
+                return false;
+        }
+
+        for (const typename _Other::OverflowSlot& slot : node.overflow) {
+            if (slot.bounds.intersects(_Bounds) &&
+                !(_Swapped ? call_visitor(_Func, slot.object, _Object) : call_visitor(_Func, _Object, slot.object)))
+                return false;
+        }
+
+        if (node.has_children()) {
+            for (size_t i = 0; i < kChildren; i++) {
+                if (!pairs_object(_Bounds, _Object, _Tree, node.first_child + static_cast<NodeIndex>(i),
+                    _Swapped, _Func))
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
+    template<typename T, size_t _Capacity>
+    inline QuadTreeShape QuadTree<T, _Capacity>::get_shape() const
+    {
+        QuadTreeShape shape;
+
+        auto area = [](const QuadTreeAABB<T>& _Bounds) {
+            return static_cast<double>(_Bounds.right - _Bounds.left) * static_cast<double>(_Bounds.bottom - _Bounds.top);
+        };
+
+        double sibling_area = 0;
+        double overlap_area = 0;
+
+        std::vector<NodeIndex> stack(1, root);
+
+        while (!stack.empty()) {
+            const Node& node = nodes[stack.back()];
+            stack.pop_back();
+
+            if (node.level >= shape.nodes.size()) {
+                shape.nodes.resize(node.level + 1);
+                shape.leaves.resize(node.level + 1);
+                shape.objects.resize(node.level + 1);
+            }
+
+            shape.node_count++;
+            shape.max_depth = std::max(shape.max_depth, node.level);
+            shape.nodes[node.level]++;
+            shape.objects[node.level] += node.slot_count();
+
+            if (!node.has_children()) {
+                shape.leaves[node.level]++;
+                continue;
+            }
+
+            for (size_t i = 0; i < kChildren; i++) {
+                const QuadTreeAABB<T>& a = nodes[node.first_child + i].max_bounds;
+
+                sibling_area += area(a);
+                stack.push_back(node.first_child + static_cast<NodeIndex>(i));
+
+                for (size_t k = i + 1; k < kChildren; k++) {
+                    const QuadTreeAABB<T>& b = nodes[node.first_child + k].max_bounds;
+
+                    if (a.intersects(b)) {
+                        overlap_area += area(QuadTreeAABB<T>(std::max(a.left, b.left), std::max(a.top, b.top),
+                            std::min(a.right, b.right), std::min(a.bottom, b.bottom)));
+                    }
+                }
+            }
+        }
+
+        shape.occupancy.resize(shape.nodes.size());
+
+        for (size_t i = 1; i < shape.nodes.size(); i++) {
+            if (shape.nodes[i] > 0)
+                shape.occupancy[i] = static_cast<double>(shape.objects[i]) / static_cast<double>(shape.nodes[i] * _Capacity);
+        }
+
+        if (sibling_area > 0)
+            shape.sibling_overlap = overlap_area / sibling_area;
+
+        return shape;
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::flatten(std::vector<QuadTreeFlatNode<T>>& _Nodes,
+        std::vector<const ObjectPtr*>& _Objects, std::vector<QuadTreeAABB<T>>& _Bounds) const
+    {
+        // the children of a node are appended together, so they end up
+        // next to each other in breadth first order
+        std::vector<NodeIndex> order(1, root);
+
+        _Nodes.clear();
+        _Objects.clear();
+        _Bounds.clear();
+
+        for (size_t i = 0; i < order.size(); i++) {
+            const Node& node = nodes[order[i]];
+            QuadTreeFlatNode<T> flat;
+
+            flat.left = node.max_bounds.left;
+            flat.top = node.max_bounds.top;
+            flat.right = node.max_bounds.right;
+            flat.bottom = node.max_bounds.bottom;
+            flat.first_object = static_cast<uint32_t>(_Objects.size());
+            flat.object_count = static_cast<uint32_t>(node.slot_count());
+            flat.first_child = static_cast<uint32_t>(order.size());
+            flat.child_count = 0;
+
+            for (size_t k = 0; k < node.slot_count(); k++) {
+                _Objects.push_back(&node.get_object(k));
+                _Bounds.push_back(node.get_object_bounds(k));
+            }
+
+            if (node.has_children()) {
+                for (size_t k = 0; k < kChildren; k++) {
+                    NodeIndex child = node.first_child + static_cast<NodeIndex>(k);
+
+                    if (nodes[child].total_count > 0) {
+                        order.push_back(child);
+                        flat.child_count++;
+                    }
+                }
+            }
+
+            _Nodes.push_back(flat);
+        }
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::serialize(std::vector<uint8_t>& _Data) const
+    {
+        std::vector<QuadTreeFlatNode<T>> flat_nodes;
+        std::vector<const ObjectPtr*> objects;
+        std::vector<QuadTreeAABB<T>> bounds;
+
+        flatten(flat_nodes, objects, bounds);
+
+        // every array starts on a 32 byte boundary
+        auto align = [](uint64_t _Offset) { return (_Offset + 31) & ~uint64_t(31); };
+
+        QuadTreeFileHeader header = QuadTreeFileHeader();
+
+        header.magic = QuadTreeFileHeader::kMagic;
+        header.version = QuadTreeFileHeader::kVersion;
+        header.scalar_size = sizeof(T);
+        header.scalar_floating = std::is_floating_point<T>::value;
+        header.node_count = flat_nodes.size();
+        header.object_count = objects.size();
+
+        uint64_t scalars = objects.size() * sizeof(T);
+
+        header.nodes = align(sizeof(header));
+        header.left = align(header.nodes + flat_nodes.size() * sizeof(QuadTreeFlatNode<T>));
+        header.top = align(header.left + scalars);
+        header.right = align(header.top + scalars);
+        header.bottom = align(header.right + scalars);
+        header.ids = align(header.bottom + scalars);
+        header.size = header.ids + objects.size() * sizeof(uint64_t);
+
+        _Data.assign(static_cast<size_t>(header.size), 0);
+
+        uint8_t* data = _Data.data();
+
+        std::memcpy(data, &header, sizeof(header));
+
+        if (!flat_nodes.empty())
+            std::memcpy(data + header.nodes, flat_nodes.data(), flat_nodes.size() * sizeof(QuadTreeFlatNode<T>));
+
+        for (size_t i = 0; i < objects.size(); i++) {
+            const QuadTreeAABB<T>& b = bounds[i];
+            uint64_t id = (*objects[i])->id;
+
+            std::memcpy(data + header.left + i * sizeof(T), &b.left, sizeof(T));
+            std::memcpy(data + header.top + i * sizeof(T), &b.top, sizeof(T));
+            std::memcpy(data + header.right + i * sizeof(T), &b.right, sizeof(T));
+            std::memcpy(data + header.bottom + i * sizeof(T), &b.bottom, sizeof(T));
+            std::memcpy(data + header.ids + i * sizeof(uint64_t), &id, sizeof(id));
+        }
+    }
+
+    template<typename T>
+    inline QuadTreeView<T>::QuadTreeView(const void* _Data, size_t _Size)
+    {
+        const uint8_t* bytes = static_cast<const uint8_t*>(_Data);
+
+        if (!bytes || _Size < sizeof(QuadTreeFileHeader) ||
+            reinterpret_cast<uintptr_t>(bytes) % alignof(QuadTreeFileHeader) != 0)
+            throw std::invalid_argument("invalid quadtree data");
+
+        const QuadTreeFileHeader* h = reinterpret_cast<const QuadTreeFileHeader*>(bytes);
+
+        if (h->magic != QuadTreeFileHeader::kMagic || h->version != QuadTreeFileHeader::kVersion)
+            throw std::invalid_argument("invalid quadtree data");
+
+        if (h->scalar_size != sizeof(T) || h->scalar_floating != std::is_floating_point<T>::value)
+            throw std::invalid_argument("quadtree coordinate type mismatch");
+
+        // every array has to fit and be aligned for its element type
+        auto check = [&](uint64_t _Offset, uint64_t _Count, uint64_t _Element, uint64_t _Align) {
+            if (_Offset % _Align != 0 || _Offset > h->size || _Count > (h->size - _Offset) / _Element)
+                throw std::invalid_argument("invalid quadtree data");
+        };
+
+        if (h->size > _Size || h->node_count > UINT32_MAX || h->object_count > UINT32_MAX)
+            throw std::invalid_argument("invalid quadtree data");
+
+        check(h->nodes, h->node_count, sizeof(QuadTreeFlatNode<T>), alignof(QuadTreeFlatNode<T>));
+        check(h->left, h->object_count, sizeof(T), alignof(T));
+        check(h->top, h->object_count, sizeof(T), alignof(T));
+        check(h->right, h->object_count, sizeof(T), alignof(T));
+        check(h->bottom, h->object_count, sizeof(T), alignof(T));
+        check(h->ids, h->object_count, sizeof(uint64_t), alignof(uint64_t));
+
+        // the node records are walked without checks later, they have to
+        // keep the breadth first layout serialize() writes: the children
+        // of each node follow the ones of the nodes before it, so every
+        // node but the root has exactly one parent placed before it
+        const QuadTreeFlatNode<T>* flat = reinterpret_cast<const QuadTreeFlatNode<T>*>(bytes + h->nodes);
+        uint64_t next_child = 1;
+
+        for (uint64_t i = 0; i < h->node_count; i++) {
+            const QuadTreeFlatNode<T>& node = flat[i];
+
+            if (node.first_object > h->object_count || node.object_count > h->object_count - node.first_object)
+                throw std::invalid_argument("invalid quadtree data");
+
+            if (node.child_count == 0)
+                continue;
+
+            if (node.child_count > 4 || node.first_child != next_child || next_child <= i ||
+                node.child_count > h->node_count - next_child)
+                throw std::invalid_argument("invalid quadtree data");
+
+            next_child += node.child_count;
+        }
+
+        if (h->node_count > 0 && next_child != h->node_count)
+            throw std::invalid_argument("invalid quadtree data");
+
+        data = bytes;
+        header = h;
+        nodes = reinterpret_cast<const QuadTreeFlatNode<T>*>(bytes + h->nodes);
+        left = reinterpret_cast<const T*>(bytes + h->left);
+        top = reinterpret_cast<const T*>(bytes + h->top);
+        right = reinterpret_cast<const T*>(bytes + h->right);
+        bottom = reinterpret_cast<const T*>(bytes + h->bottom);
+        ids = reinterpret_cast<const uint64_t*>(bytes + h->ids);
+    }
+
+    template<typename T, size_t _Capacity>
+    inline QuadTreeFrozen<T> QuadTree<T, _Capacity>::freeze() const
+    {
+        QuadTreeFrozen<T> frozen;
+        std::vector<const ObjectPtr*> objects;
+        std::vector<QuadTreeAABB<T>> bounds;
+
+        flatten(frozen.nodes, objects, bounds);
+
+        frozen.bounds = nodes[root].bounds;
+        frozen.left.reserve(objects.size());
+        frozen.top.reserve(objects.size());
+        frozen.right.reserve(objects.size());
+        frozen.bottom.reserve(objects.size());
+        frozen.objects.reserve(objects.size());
+
+        for (size_t i = 0; i < objects.size(); i++) {
+            const QuadTreeAABB<T>& b = bounds[i];
+
+            frozen.left.push_back(b.left);
+            frozen.top.push_back(b.top);
+            frozen.right.push_back(b.right);
+            frozen.bottom.push_back(b.bottom);
+            frozen.objects.push_back(*objects[i]);
+        }
+
+        frozen.nodes.shrink_to_fit();
+        return frozen;
+    }
+
+    template<typename T>
+    template<typename _Shape, typename _Visitor>
+    inline bool QuadTreeFrozen<T>::query_shape(uint32_t _Node, const _Shape& _Query,
+        const QuadTreeAABB<T>& _Bounds, _Visitor& _Func) const
+    {
+        const QuadTreeFlatNode<T>& node = nodes[_Node];
+        const QuadTreeAABB<T> node_bounds(node.left, node.top, node.right, node.bottom);
+
+        if (!node_bounds.intersects(_Bounds) || !_Query.intersects(node_bounds))
+            return true;
+
+        // the bounding box of the shape filters the objects first
+        static constexpr uint32_t kChunk = 64;
+        uint32_t hits[kChunk];
+
+        for (uint32_t first = node.first_object; first < node.first_object + node.object_count; first += kChunk) {
+            size_t count = std::min(kChunk, node.first_object + node.object_count - first);
+            size_t hit_count = query_batch(_Bounds, left.data() + first, top.data() + first,
+                right.data() + first, bottom.data() + first, count, hits);
+
+            for (size_t i = 0; i < hit_count; i++) {
+                uint32_t object = first + hits[i];
+
+                if (_Query.intersects(QuadTreeAABB<T>(left[object], top[object], right[object], bottom[object])) &&
+                    !call_visitor(_Func, objects[object]))
+                    return false;
+            }
+        }
+
+        for (uint32_t i = 0; i < node.child_count; i++) {
+            if (!query_shape(node.first_child + i, _Query, _Bounds, _Func))
+                return false;
+        }
+
+        return true;
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::query_many(const QuadTreeAABB<T>* _Queries, size_t _Count,
+        std::vector<size_t>& _Offsets, std::vector<ObjectPtr>& _Objects) const
+    {
+        std::vector<uint32_t> active(_Count);
+        std::vector<QueryHit> hits;
+
+        for (size_t i = 0; i < _Count; i++)
+            active[i] = static_cast<uint32_t>(i);
+
+        query_many(root, _Queries, active, 0, hits);
+
+        // bucket the hits by query
+        _Offsets.assign(_Count + 1, 0);
+
+        for (const QueryHit& hit : hits)
+            _Offsets[hit.query + 1]++;
+
+        for (size_t i = 0; i < _Count; i++)
+            _Offsets[i + 1] += _Offsets[i];
+
+        std::vector<size_t> cursor(_Offsets.begin(), _Offsets.end() - 1);
+
+        _Objects.clear();
+        _Objects.resize(hits.size());
+
+        for (const QueryHit& hit : hits)
+            _Objects[cursor[hit.query]++] = *hit.object;
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::query_many(NodeIndex _Node, const QuadTreeAABB<T>* _Queries,
+        std::vector<uint32_t>& _Active, size_t _Begin, std::vector<QueryHit>& _Hits) const
+    {
+        const Node& node = nodes[_Node];
+
+        // the queries of the parent are [_Begin, end), the ones touching
+        // this node are appended after them and dropped on return
+        size_t end = _Active.size();
+
+        for (size_t i = _Begin; i < end; i++) {
+            if (node.max_bounds.intersects(_Queries[_Active[i]]))
+                _Active.push_back(_Active[i]);
+        }
+
+        if (_Active.size() == end) {
+            NC_QUADTREE_COUNT(nodes_pruned, 1);
+            return;
+        }
+
+        NC_QUADTREE_COUNT(nodes_visited, 1);
+        NC_QUADTREE_COUNT(slot_tests, node.slot_count() * (_Active.size() - end));
+
+        if (node.has_children()) {
+            for (size_t i = 0; i < kChildren; i++)
+                query_many(node.first_child + i, _Queries, _Active, end, _Hits);
+        }
+
+        if (node.object_count > 0) {
+            uint32_t hits[_Capacity];
+
+            for (size_t i = end; i < _Active.size(); i++) {
+                uint32_t query = _Active[i];
+                size_t hit_count = query_batch(_Queries[query], node.object_bounds, node.object_count, hits);
+
+                NC_QUADTREE_COUNT(hits, hit_count);
+
+                for (size_t k = 0; k < hit_count; k++)
+                    _Hits.push_back({ query, &node.objects[hits[k]] });
+
+                for (const OverflowSlot& slot : node.overflow) {
+                    if (slot.bounds.intersects(_Queries[query])) {
+                        NC_QUADTREE_COUNT(hits, 1);
+                        _Hits.push_back({ query, &slot.object });
+                    }
+                }
+            }
+        }
+
+        _Active.resize(end);
+    }
+
+    template<typename T, size_t _Capacity>
+    template<typename _Shape, typename _Visitor>
+    inline bool QuadTree<T, _Capacity>::query_shape(NodeIndex _Node, const _Shape& _Query,
+        const QuadTreeAABB<T>& _Bounds, _Visitor& _Func) const
+    {
+        const Node& node = nodes[_Node];
+
+        if (!node.max_bounds.intersects(_Bounds) || !_Query.intersects(node.max_bounds)) {
+            NC_QUADTREE_COUNT(nodes_pruned, 1);
+            return true;
+        }
+
+        NC_QUADTREE_COUNT(nodes_visited, 1);
+        NC_QUADTREE_COUNT(slot_tests, node.slot_count());
+
+        if (node.has_children()) {
+            for (size_t i = 0; i < kChildren; i++) {
+                if (!query_shape(node.first_child + i, _Query, _Bounds, _Func))
+                    return false;
+            }
+        }
+
+        // the bounding box of the shape filters the slots first
+        uint32_t hits[_Capacity];
+        size_t hit_count = query_batch(_Bounds, node.object_bounds, node.object_count, hits);
+
+        for (size_t i = 0; i < hit_count; i++) {
+            if (_Query.intersects(node.object_bounds.get(hits[i]))) {
+                NC_QUADTREE_COUNT(hits, 1);
+
+                if (!call_visitor(_Func, node.objects[hits[i]]))
+                    return false;
+            }
+        }
+
+        for (const OverflowSlot& slot : node.overflow) {
+            if (slot.bounds.intersects(_Bounds) && _Query.intersects(slot.bounds)) {
+                NC_QUADTREE_COUNT(hits, 1);
+
+                if (!call_visitor(_Func, slot.object))
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::collect_tasks(NodeIndex _Node, const QuadTreeAABB<T>& _Bounds,
+        size_t _Grain, std::vector<NodeIndex>& _Tasks, std::vector<ObjectPtr>& _Objects) const
+    {
+        const Node& node = nodes[_Node];
+
+        if (!node.max_bounds.intersects(_Bounds))
+            return;
+
+        if (node.total_count <= _Grain || !node.has_children()) {
+            _Tasks.push_back(_Node);
+            return;
+        }
+
+        for (size_t i = 0; i < kChildren; i++)
+            collect_tasks(node.first_child + i, _Bounds, _Grain, _Tasks, _Objects);
+
+        // the few objects stored above the task roots are scanned here
+        uint32_t hits[_Capacity];
+        size_t hit_count = query_batch(_Bounds, node.object_bounds, node.object_count, hits);
+
+        for (size_t i = 0; i < hit_count; i++)
+            _Objects.push_back(node.objects[hits[i]]);
+
+        for (const OverflowSlot& slot : node.overflow) {
+            if (slot.bounds.intersects(_Bounds))
+                _Objects.push_back(slot.object);
+        }
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTree<T, _Capacity>::parallel_query(const QuadTreeAABB<T>& _Bounds,
+        std::vector<ObjectPtr>& _Objects, size_t _Threads, size_t _Grain) const
+    {
+        if (_Threads == 0)
+            _Threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+
+        _Grain = std::max<size_t>(1, _Grain);
+
+        if (_Threads < 2) {
+            query(_Bounds, _Objects);
+            return;
+        }
+
+        std::vector<NodeIndex> tasks;
+        collect_tasks(root, _Bounds, _Grain, tasks, _Objects);
+
+        // a small query only reaches a few subtrees, waking the workers
+        // would cost more than it saves
+        size_t work = 0;
+
+        for (NodeIndex task : tasks)
+            work += nodes[task].total_count;
+
+        _Threads = std::min(_Threads, tasks.size());
+
+        if (_Threads < 2 || work < _Grain * 2) {
+            for (NodeIndex task : tasks) {
+                auto append = [&](const ObjectPtr& _Object) { _Objects.push_back(_Object); };
+                query(task, _Bounds, append, true);
+            }
+
+            return;
+        }
+
+        std::vector<std::vector<ObjectPtr>> results(_Threads);
+
+        run_parallel(tasks.size(), _Threads, [&](size_t _Task, size_t _Worker) {
+            std::vector<ObjectPtr>& result = results[_Worker];
+            auto append = [&](const ObjectPtr& _Object) { result.push_back(_Object); };
+
+            query(tasks[_Task], _Bounds, append, true);
+        });
+
+        size_t total = _Objects.size();
+
+        for (const std::vector<ObjectPtr>& result : results)
+            total += result.size();
+
+        _Objects.reserve(total);
+
+        for (std::vector<ObjectPtr>& result : results)
+            std::move(result.begin(), result.end(), std::back_inserter(_Objects));
     }
 } // namespace nc
 
@@ -0,0 +1,336 @@
+// ================================= //
+//                                   //
+// QuadTree Version 0.1a             //
+// Copyright (c)2017 NuclearC        //
+//                                   //
+// ================================= //
+
+// benchmark harness, build with for example
+//   g++ -std=c++11 -O2 -DNDEBUG -pthread quadtree_bench.cpp -o quadtree_bench
+// and run ./quadtree_bench [--min N] [--max N] [--queries N] [--seed N]
+// results are printed as csv, one measurement per line
+
+#include "quadtree.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    struct Options {
+        size_t min_count = 1000;
+        size_t max_count = 100000;
+        size_t queries = 2000;
+        unsigned seed = 1;
+    };
+
+    enum class Workload {
+        Uniform,
+        Clustered,
+        Moving
+    };
+
+    const char* workload_name(Workload _Workload) {
+        switch (_Workload) {
+        case Workload::Uniform: return "uniform";
+        case Workload::Clustered: return "clustered";
+        default: return "moving";
+        }
+    }
+
+    template <typename T> const char* type_name();
+    template <> const char* type_name<float>() { return "float"; }
+    template <> const char* type_name<double>() { return "double"; }
+    template <> const char* type_name<int32_t>() { return "int32"; }
+
+    // the same world for every coordinate type, small enough for float
+    // and int32 to keep some precision at the object sizes used below
+    const double kWorld = 1 << 20;
+
+    using Clock = std::chrono::steady_clock;
+
+    double seconds_since(Clock::time_point _Start) {
+        return std::chrono::duration<double>(Clock::now() - _Start).count();
+    }
+
+    void report(const char* _Type, size_t _Capacity, Workload _Workload, size_t _Count,
+        const char* _Metric, double _Value, const char* _Unit) {
+        std::printf("%s,%zu,%s,%zu,%s,%.6g,%s\n", _Type, _Capacity, workload_name(_Workload),
+            _Count, _Metric, _Value, _Unit);
+    }
+
+    template <typename T>
+    nc::QuadTreeAABB<T> make_box(double _X, double _Y, double _Width, double _Height) {
+        double left = std::min(std::max(_X, 0.0), kWorld - _Width - 1);
+        double top = std::min(std::max(_Y, 0.0), kWorld - _Height - 1);
+
+        return nc::QuadTreeAABB<T>(static_cast<T>(left), static_cast<T>(top),
+            static_cast<T>(left + _Width), static_cast<T>(top + _Height));
+    }
+
+    // boxes up to the mean spacing in size so the density stays the
+    // same at every count
+    template <typename T>
+    std::vector<nc::QuadTreeAABB<T>> generate(Workload _Workload, size_t _Count, std::mt19937& _Random) {
+        const double spacing = kWorld / std::sqrt(static_cast<double>(_Count));
+
+        std::uniform_real_distribution<double> position(0, kWorld);
+        std::uniform_real_distribution<double> extent(spacing * 0.1, spacing);
+
+        std::vector<nc::QuadTreeAABB<T>> boxes;
+        boxes.reserve(_Count);
+
+        if (_Workload == Workload::Clustered) {
+            const size_t kClusters = 16;
+
+            std::vector<std::pair<double, double>> centers;
+
+            for (size_t i = 0; i < kClusters; i++)
+                centers.push_back({ position(_Random), position(_Random) });
+
+            std::normal_distribution<double> offset(0, kWorld / 64);
+
+            for (size_t i = 0; i < _Count; i++) {
+                const std::pair<double, double>& center = centers[i % kClusters];
+
+                boxes.push_back(make_box<T>(center.first + offset(_Random), center.second + offset(_Random),
+                    extent(_Random) * 0.25, extent(_Random) * 0.25));
+            }
+        }
+        else {
+            for (size_t i = 0; i < _Count; i++)
+                boxes.push_back(make_box<T>(position(_Random), position(_Random), extent(_Random), extent(_Random)));
+        }
+
+        return boxes;
+    }
+
+    // memory held by the nodes reachable from the root
+    template <typename _Tree>
+    size_t tree_bytes(const _Tree& _QuadTree, typename _Tree::NodeIndex _Node) {
+        const typename _Tree::Node& node = _QuadTree.get_node(_Node);
+        size_t bytes = sizeof(node) + node.overflow.capacity() * sizeof(node.overflow[0]);
+
+        if (node.has_children()) {
+            for (size_t i = 0; i < 4; i++)
+                bytes += tree_bytes(_QuadTree, node.first_child + static_cast<typename _Tree::NodeIndex>(i));
+        }
+
+        return bytes;
+    }
+
+    double percentile(std::vector<double>& _Samples, double _Fraction) {
+        if (_Samples.empty())
+            return 0;
+
+        size_t rank = static_cast<size_t>(_Fraction * static_cast<double>(_Samples.size() - 1));
+
+        std::nth_element(_Samples.begin(), _Samples.begin() + rank, _Samples.end());
+        return _Samples[rank];
+    }
+
+    template <typename T, size_t _Capacity>
+    void run(const Options& _Options, Workload _Workload, size_t _Count) {
+        using Tree = nc::QuadTree<T, _Capacity>;
+        using ObjectPtr = typename Tree::ObjectPtr;
+
+        const char* type = type_name<T>();
+
+        std::mt19937 random(_Options.seed);
+        std::vector<nc::QuadTreeAABB<T>> boxes = generate<T>(_Workload, _Count, random);
+
+        std::vector<ObjectPtr> objects;
+        objects.reserve(_Count);
+
+        for (size_t i = 0; i < _Count; i++)
+            objects.push_back(std::make_shared<typename Tree::Object>(boxes[i], nullptr, i));
+
+        const nc::QuadTreeAABB<T> world(T(0), T(0), static_cast<T>(kWorld), static_cast<T>(kWorld));
+        Tree tree(world);
+
+        // build
+        Clock::time_point start = Clock::now();
+        tree.build(objects.begin(), objects.end());
+        report(type, _Capacity, _Workload, _Count, "build", _Count / seconds_since(start), "ops/s");
+
+        // insert one by one
+        tree = Tree(world);
+        start = Clock::now();
+
+        for (const ObjectPtr& object : objects)
+            tree.insert(object);
+
+        report(type, _Capacity, _Workload, _Count, "insert", _Count / seconds_since(start), "ops/s");
+        report(type, _Capacity, _Workload, _Count, "tree_memory",
+            tree_bytes(tree, tree.get_root()) / 1024.0, "kB");
+
+        // query latency for boxes of a thousandth, a hundredth and a tenth
+        // of the world
+        const double sizes[3] = { kWorld / 1000, kWorld / 100, kWorld / 10 };
+        const char* names[3][4] = {
+            { "query_small_p50", "query_small_p90", "query_small_p99", "query_small_hits" },
+            { "query_medium_p50", "query_medium_p90", "query_medium_p99", "query_medium_hits" },
+            { "query_large_p50", "query_large_p90", "query_large_p99", "query_large_hits" }
+        };
+
+        std::uniform_real_distribution<double> position(0, kWorld);
+        std::vector<ObjectPtr> result;
+        std::vector<double> samples(_Options.queries);
+
+        for (size_t s = 0; s < 3; s++) {
+            size_t hits = 0;
+
+            for (size_t i = 0; i < _Options.queries; i++) {
+                nc::QuadTreeAABB<T> query = make_box<T>(position(random), position(random), sizes[s], sizes[s]);
+
+                result.clear();
+                start = Clock::now();
+                tree.query(query, result);
+                samples[i] = seconds_since(start) * 1e9;
+                hits += result.size();
+            }
+
+            report(type, _Capacity, _Workload, _Count, names[s][0], percentile(samples, 0.5), "ns");
+            report(type, _Capacity, _Workload, _Count, names[s][1], percentile(samples, 0.9), "ns");
+            report(type, _Capacity, _Workload, _Count, names[s][2], percentile(samples, 0.99), "ns");
+            report(type, _Capacity, _Workload, _Count, names[s][3],
+                static_cast<double>(hits) / static_cast<double>(_Options.queries), "objects");
+        }
+
+        // update, the moving workload steps every object along its own
+        // velocity for a few frames, the others move each object once by
+        // about its own size
+        const double spacing = kWorld / std::sqrt(static_cast<double>(_Count));
+        const size_t frames = _Workload == Workload::Moving ? 8 : 1;
+
+        std::uniform_real_distribution<double> velocity(-spacing * 0.5, spacing * 0.5);
+        std::vector<std::pair<double, double>> velocities(_Count);
+
+        for (std::pair<double, double>& v : velocities)
+            v = { velocity(random), velocity(random) };
+
+        size_t updates = 0;
+        start = Clock::now();
+
+        for (size_t frame = 0; frame < frames; frame++) {
+            for (size_t i = 0; i < _Count; i++) {
+                const nc::QuadTreeAABB<T>& b = objects[i]->bounds;
+                double width = static_cast<double>(b.right - b.left);
+                double height = static_cast<double>(b.bottom - b.top);
+
+                tree.update(objects[i], make_box<T>(static_cast<double>(b.left) + velocities[i].first,
+                    static_cast<double>(b.top) + velocities[i].second, width, height));
+                updates++;
+            }
+        }
+
+        report(type, _Capacity, _Workload, _Count, "update", updates / seconds_since(start), "ops/s");
+
+        // remove in a different order than the inserts
+        std::shuffle(objects.begin(), objects.end(), random);
+        start = Clock::now();
+
+        for (const ObjectPtr& object : objects)
+            tree.remove(object);
+
+        report(type, _Capacity, _Workload, _Count, "remove", _Count / seconds_since(start), "ops/s");
+    }
+
+    // each run gets its own process where fork() is available, so the
+    // peak resident set of the child belongs to that run alone. elsewhere
+    // the runs share the process and no peak is reported
+    template <typename T, size_t _Capacity>
+    void run_isolated(const Options& _Options, Workload _Workload, size_t _Count) {
+#if defined(__unix__) || defined(__APPLE__)
+        std::fflush(stdout);
+
+        pid_t child = fork();
+
+        if (child == 0) {
+            run<T, _Capacity>(_Options, _Workload, _Count);
+            std::fflush(stdout);
+            std::_Exit(0);
+        }
+
+        if (child > 0) {
+            int status = 0;
+            rusage usage;
+
+            if (wait4(child, &status, 0, &usage) != child || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                std::fprintf(stderr, "run %s/%zu/%s/%zu failed\n", type_name<T>(), _Capacity,
+                    workload_name(_Workload), _Count);
+                std::exit(1);
+            }
+
+#if defined(__APPLE__)
+            long peak = usage.ru_maxrss / 1024;
+#else
+            long peak = usage.ru_maxrss;
+#endif
+            report(type_name<T>(), _Capacity, _Workload, _Count, "peak_memory", static_cast<double>(peak), "kB");
+            return;
+        }
+#endif
+        run<T, _Capacity>(_Options, _Workload, _Count);
+    }
+
+    template <typename T, size_t _Capacity>
+    void sweep(const Options& _Options) {
+        const Workload workloads[3] = { Workload::Uniform, Workload::Clustered, Workload::Moving };
+
+        for (Workload workload : workloads) {
+            for (size_t count = _Options.min_count; count <= _Options.max_count; count *= 10)
+                run_isolated<T, _Capacity>(_Options, workload, count);
+        }
+    }
+
+    template <typename T>
+    void sweep_capacities(const Options& _Options) {
+        sweep<T, 2>(_Options);
+        sweep<T, 8>(_Options);
+        sweep<T, 32>(_Options);
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        unsigned long long value = std::strtoull(argv[i + 1], nullptr, 10);
+
+        if (!std::strcmp(argv[i], "--min"))
+            options.min_count = static_cast<size_t>(value);
+        else if (!std::strcmp(argv[i], "--max"))
+            options.max_count = static_cast<size_t>(value);
+        else if (!std::strcmp(argv[i], "--queries"))
+            options.queries = static_cast<size_t>(value);
+        else if (!std::strcmp(argv[i], "--seed"))
+            options.seed = static_cast<unsigned>(value);
+        else {
+            std::fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+
+    if (options.min_count == 0)
+        options.min_count = 1;
+
+    std::printf("type,capacity,workload,count,metric,value,unit\n");
+
+    sweep_capacities<float>(options);
+    sweep_capacities<double>(options);
+    sweep_capacities<int32_t>(options);
+
+    return 0;
+}
@@ -0,0 +1,463 @@
+// ================================= //
+//                                   //
+// QuadTree Version 0.1a             //
+// Copyright (c) 2017 NuclearC       //
+//                                   //
+// ================================= //
+
+// quadtree_grid.h: uniform grid with a quadtree in every dense cell
+
+#ifndef NC_QUADTREE_GRID_H_
+#define NC_QUADTREE_GRID_H_
+
+#include "quadtree.h"
+
+namespace nc {
+    // hybrid index for worlds that mix sparse and packed areas. a uniform
+    // grid over the space addresses cells in O(1), each cell keeps its
+    // objects in a flat bucket and switches to its own QuadTree once the
+    // bucket gets dense. an object is filed under the cell of its top left
+    // corner, queries widen their cell range by the largest object seen so
+    // nothing is reported twice. objects outside the space go to the edge
+    // cells. build() picks the grid resolution from the object density
+    template <typename T = double, size_t _Capacity = 8>
+    class QuadTreeGrid {
+    public:
+        using Tree = QuadTree<T, _Capacity>;
+        using Object = QuadTreeObject<T>;
+        using ObjectPtr = std::shared_ptr<Object>;
+
+        // average objects per cell build() aims for
+        static constexpr size_t kCellObjects = 16;
+
+        // a bucket turns into a tree above this many objects, a tree goes
+        // back to a bucket below half of it
+        static constexpr size_t kTreeObjects = 64;
+
+        static constexpr size_t kMaxCells = size_t(1) << 20;
+    private:
+        struct Entry {
+            QuadTreeAABB<T> bounds;
+            ObjectPtr object;
+        };
+
+        struct Cell {
+            std::vector<Entry> bucket;
+            std::unique_ptr<Tree> tree;
+        };
+
+        using Scalar = QuadTreeScalar<T>;
+
+        QuadTreeAABB<T> bounds;
+        size_t columns = 1, rows = 1;
+        Scalar column_scale = 0, row_scale = 0;
+
+        std::vector<Cell> cells;
+        size_t total_count = 0;
+        size_t tree_count = 0;
+
+        // largest object extent so far, only grows until the next build()
+        Scalar max_width = 0, max_height = 0;
+
+        size_t column(Scalar _X) const;
+        size_t row(Scalar _Y) const;
+
+        Cell& cell_of(const QuadTreeAABB<T>& _Bounds) {
+            return cells[row(_Bounds.top) * columns + column(_Bounds.left)];
+        }
+
+        QuadTreeAABB<T> cell_bounds(size_t _Column, size_t _Row) const;
+
+        // resizes the grid, the objects have to be filed again
+        void reset(size_t _Columns, size_t _Rows);
+
+        bool file(Cell& _Cell, size_t _Index, const ObjectPtr& _Object);
+        bool unfile(Cell& _Cell, const ObjectPtr& _Object);
+
+        void to_tree(Cell& _Cell, size_t _Index);
+        void to_bucket(Cell& _Cell);
+    public:
+        QuadTreeGrid() { reset(1, 1); }
+
+        QuadTreeGrid(const QuadTreeAABB<T>& _Bounds, size_t _Columns = 1, size_t _Rows = 1)
+            : bounds(_Bounds) {
+            reset(_Columns, _Rows);
+        }
+
+        // the objects have to be inserted again after the space changes
+        void set_bounds(const QuadTreeAABB<T>& _Bounds) {
+            bounds = _Bounds;
+            reset(columns, rows);
+        }
+
+        const QuadTreeAABB<T>& get_bounds() const { return bounds; }
+
+        // changes the resolution and files the objects again
+        void set_resolution(size_t _Columns, size_t _Rows);
+
+        size_t get_columns() const { return columns; }
+        size_t get_rows() const { return rows; }
+
+        void clear() { reset(columns, rows); }
+
+        // false for boxes without area, see verify(). one lying on the top
+        // or left edge of its cell overlaps none of the cell, a cell tree
+        // would turn it away once the bucket grows into one
+        bool insert(const ObjectPtr& _Object);
+
+        bool remove(const ObjectPtr& _Object);
+
+        // moves _Object to _Bounds, in its cell while the corner stays in it.
+        // false for boxes without area, like insert()
+        bool update(const ObjectPtr& _Object, const QuadTreeAABB<T>& _Bounds);
+
+        // replaces the contents with [_Begin, _End). the resolution is
+        // chosen so an average cell holds about kCellObjects objects,
+        // cells packed beyond kTreeObjects are built as trees. boxes
+        // without area are skipped. returns the number of objects stored
+        template <typename _Iterator>
+        size_t build(_Iterator _Begin, _Iterator _End);
+
+        void query(const QuadTreeAABB<T>& _Boundaries, ObjectPtr* _Objects, size_t& _Length) const {
+            auto append = [&](const ObjectPtr& _Object) { _Objects[_Length++] = _Object; };
+            query(_Boundaries, append);
+        }
+
+        void query(const QuadTreeAABB<T>& _Boundaries, std::vector<ObjectPtr>& _Objects) const {
+            auto append = [&](const ObjectPtr& _Object) { _Objects.push_back(_Object); };
+            query(_Boundaries, append);
+        }
+
+        // calls _Func(const ObjectPtr&) for every object intersecting
+        // _Boundaries. if _Func returns a bool, false stops the query.
+        // returns false if it was stopped early
+        template <typename _Visitor>
+        bool query(const QuadTreeAABB<T>& _Boundaries, _Visitor&& _Func) const;
+
+        size_t get_total_objects() const { return total_count; }
+
+        // cells that currently use a tree
+        size_t get_tree_cells() const { return tree_count; }
+    };
+
+    template<typename T, size_t _Capacity>
+    inline size_t QuadTreeGrid<T, _Capacity>::column(Scalar _X) const
+    {
+        Scalar x = (_X - static_cast<Scalar>(bounds.left)) * column_scale;
+
+        // nan and everything left of the space go to the first column
+        if (!(x > 0))
+            return 0;
+
+        if (x >= static_cast<Scalar>(columns))
+            return columns - 1;
+
+        return static_cast<size_t>(x);
+    }
+
+    template<typename T, size_t _Capacity>
+    inline size_t QuadTreeGrid<T, _Capacity>::row(Scalar _Y) const
+    {
+        Scalar y = (_Y - static_cast<Scalar>(bounds.top)) * row_scale;
+
+        // nan and everything above the space go to the first row
+        if (!(y > 0))
+            return 0;
+
+        if (y >= static_cast<Scalar>(rows))
+            return rows - 1;
+
+        return static_cast<size_t>(y);
+    }
+
+    template<typename T, size_t _Capacity>
+    inline QuadTreeAABB<T> QuadTreeGrid<T, _Capacity>::cell_bounds(size_t _Column, size_t _Row) const
+    {
+        const Scalar width = static_cast<Scalar>(bounds.right) - static_cast<Scalar>(bounds.left);
+        const Scalar height = static_cast<Scalar>(bounds.bottom) - static_cast<Scalar>(bounds.top);
+
+        // the last cells end exactly on the space
+        return make_covering_aabb<T>(
+            static_cast<Scalar>(bounds.left) + width * static_cast<Scalar>(_Column) / static_cast<Scalar>(columns),
+            static_cast<Scalar>(bounds.top) + height * static_cast<Scalar>(_Row) / static_cast<Scalar>(rows),
+            _Column + 1 == columns ? static_cast<Scalar>(bounds.right) :
+                static_cast<Scalar>(bounds.left) + width * static_cast<Scalar>(_Column + 1) / static_cast<Scalar>(columns),
+            _Row + 1 == rows ? static_cast<Scalar>(bounds.bottom) :
+                static_cast<Scalar>(bounds.top) + height * static_cast<Scalar>(_Row + 1) / static_cast<Scalar>(rows));
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTreeGrid<T, _Capacity>::reset(size_t _Columns, size_t _Rows)
+    {
+        _Columns = std::max<size_t>(_Columns, 1);
+        _Rows = std::max<size_t>(_Rows, 1);
+
+        // checked before anything changes so a throw leaves the grid intact
+        if (_Columns > kMaxCells / _Rows)
+            throw std::invalid_argument("grid resolution too large");
+
+        columns = _Columns;
+        rows = _Rows;
+
+        const Scalar width = static_cast<Scalar>(bounds.right) - static_cast<Scalar>(bounds.left);
+        const Scalar height = static_cast<Scalar>(bounds.bottom) - static_cast<Scalar>(bounds.top);
+
+        column_scale = width > 0 ? static_cast<Scalar>(columns) / width : 0;
+        row_scale = height > 0 ? static_cast<Scalar>(rows) / height : 0;
+
+        cells.clear();
+        cells.resize(columns * rows);
+        total_count = 0;
+        tree_count = 0;
+        max_width = 0;
+        max_height = 0;
+    }
+
+    template<typename T, size_t _Capacity>
+    inline bool QuadTreeGrid<T, _Capacity>::file(Cell& _Cell, size_t _Index, const ObjectPtr& _Object)
+    {
+        const QuadTreeAABB<T>& b = _Object->bounds;
+
+        max_width = std::max(max_width, static_cast<Scalar>(b.right) - static_cast<Scalar>(b.left));
+        max_height = std::max(max_height, static_cast<Scalar>(b.bottom) - static_cast<Scalar>(b.top));
+
+        if (_Cell.tree) {
+            // false once the tree cannot grow that far
+            if (!_Cell.tree->insert(_Object))
+                return false;
+        }
+        else {
+            _Cell.bucket.push_back(Entry{ b, _Object });
+
+            if (_Cell.bucket.size() > kTreeObjects)
+                to_tree(_Cell, _Index);
+        }
+
+        total_count++;
+        return true;
+    }
+
+    template<typename T, size_t _Capacity>
+    inline bool QuadTreeGrid<T, _Capacity>::unfile(Cell& _Cell, const ObjectPtr& _Object)
+    {
+        if (_Cell.tree) {
+            if (!_Cell.tree->remove(_Object))
+                return false;
+
+            if (_Cell.tree->get_total_objects() < kTreeObjects / 2)
+                to_bucket(_Cell);
+        }
+        else {
+            auto it = std::find_if(_Cell.bucket.begin(), _Cell.bucket.end(),
+                [&](const Entry& _Entry) { return _Entry.object == _Object; });
+
+            if (it == _Cell.bucket.end())
+                return false;
+
+            *it = std::move(_Cell.bucket.back());
+            _Cell.bucket.pop_back();
+        }
+
+        total_count--;
+        return true;
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTreeGrid<T, _Capacity>::to_tree(Cell& _Cell, size_t _Index)
+    {
+        // edge cells also hold objects outside the space, the tree grows
+        // to fit them
+        std::unique_ptr<Tree> tree(new Tree(cell_bounds(_Index % columns, _Index / columns)));
+        tree->set_grow_enabled(true);
+
+        std::vector<ObjectPtr> objects;
+        objects.reserve(_Cell.bucket.size());
+
+        for (const Entry& entry : _Cell.bucket)
+            objects.push_back(entry.object);
+
+        tree->build(objects.begin(), objects.end());
+
+        _Cell.tree = std::move(tree);
+        std::vector<Entry>().swap(_Cell.bucket);
+        tree_count++;
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTreeGrid<T, _Capacity>::to_bucket(Cell& _Cell)
+    {
+        auto append = [&](const ObjectPtr& _Object) { _Cell.bucket.push_back(Entry{ _Object->bounds, _Object }); };
+
+        _Cell.tree->query(_Cell.tree->get_max_bounds(), append);
+        _Cell.tree.reset();
+        tree_count--;
+    }
+
+    template<typename T, size_t _Capacity>
+    inline void QuadTreeGrid<T, _Capacity>::set_resolution(size_t _Columns, size_t _Rows)
+    {
+        std::vector<ObjectPtr> objects;
+        objects.reserve(total_count);
+
+        query(QuadTreeAABB<T>(std::numeric_limits<T>::lowest(), std::numeric_limits<T>::lowest(),
+            std::numeric_limits<T>::max(), std::numeric_limits<T>::max()), objects);
+
+        reset(_Columns, _Rows);
+
+        for (const ObjectPtr& object : objects)
+            insert(object);
+    }
+
+    template<typename T, size_t _Capacity>
+    inline bool QuadTreeGrid<T, _Capacity>::insert(const ObjectPtr& _Object)
+    {
+        // see the declaration, a cell tree may not be able to place it
+        if (!_Object->bounds.verify())
+            return false;
+
+        const size_t index = row(_Object->bounds.top) * columns + column(_Object->bounds.left);
+
+        return file(cells[index], index, _Object);
+    }
+
+    template<typename T, size_t _Capacity>
+    inline bool QuadTreeGrid<T, _Capacity>::remove(const ObjectPtr& _Object)
+    {
+        return unfile(cell_of(_Object->bounds), _Object);
+    }
+
+    template<typename T, size_t _Capacity>
+    inline bool QuadTreeGrid<T, _Capacity>::update(const ObjectPtr& _Object, const QuadTreeAABB<T>& _Bounds)
+    {
+        if (!_Bounds.verify())
+            return false;
+
+        Cell& cell = cell_of(_Object->bounds);
+        const size_t index = row(_Bounds.top) * columns + column(_Bounds.left);
+
+        if (&cells[index] == &cell) {
+            max_width = std::max(max_width, static_cast<Scalar>(_Bounds.right) - static_cast<Scalar>(_Bounds.left));
+            max_height = std::max(max_height, static_cast<Scalar>(_Bounds.bottom) - static_cast<Scalar>(_Bounds.top));
+
+            if (cell.tree)
+                return cell.tree->update(_Object, _Bounds);
+
+            for (Entry& entry : cell.bucket) {
+                if (entry.object == _Object) {
+                    entry.bounds = _Bounds;
+                    _Object->bounds = _Bounds;
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        if (!unfile(cell, _Object))
+            return false;
+
+        _Object->bounds = _Bounds;
+        return file(cells[index], index, _Object);
+    }
+
+    template<typename T, size_t _Capacity>
+    template<typename _Iterator>
+    inline size_t QuadTreeGrid<T, _Capacity>::build(_Iterator _Begin, _Iterator _End)
+    {
+        std::vector<ObjectPtr> objects;
+
+        for (; _Begin != _End; ++_Begin) {
+            if (*_Begin && (*_Begin)->bounds.verify())
+                objects.push_back(*_Begin);
+        }
+
+        // cells of about the same width and height, as many as the density
+        // asks for
+        const Scalar width = static_cast<Scalar>(bounds.right) - static_cast<Scalar>(bounds.left);
+        const Scalar height = static_cast<Scalar>(bounds.bottom) - static_cast<Scalar>(bounds.top);
+        const double wanted = std::min(static_cast<double>(kMaxCells),
+            std::max(1.0, static_cast<double>(objects.size()) / kCellObjects));
+
+        size_t new_columns = 1, new_rows = 1;
+
+        if (width > 0 && height > 0) {
+            const double aspect = static_cast<double>(width) / static_cast<double>(height);
+
+            // a very wide space gets a single row of at most wanted cells
+            new_columns = static_cast<size_t>(std::max(1.0, std::min(wanted, std::sqrt(wanted * aspect))));
+            new_rows = std::max<size_t>(1, std::min(kMaxCells / new_columns,
+                static_cast<size_t>(wanted / static_cast<double>(new_columns))));
+        }
+
+        reset(new_columns, new_rows);
+
+        // sort into the cells first so the dense ones are built as trees
+        // in one go instead of growing from a bucket
+        std::vector<std::vector<ObjectPtr>> pending(cells.size());
+
+        for (const ObjectPtr& object : objects) {
+            const QuadTreeAABB<T>& b = object->bounds;
+
+            max_width = std::max(max_width, static_cast<Scalar>(b.right) - static_cast<Scalar>(b.left));
+            max_height = std::max(max_height, static_cast<Scalar>(b.bottom) - static_cast<Scalar>(b.top));
+            pending[row(b.top) * columns + column(b.left)].push_back(object);
+        }
+
+        for (size_t i = 0; i < cells.size(); i++) {
+            Cell& cell = cells[i];
+
+            if (pending[i].size() > kTreeObjects) {
+                cell.tree.reset(new Tree(cell_bounds(i % columns, i / columns)));
+                cell.tree->set_grow_enabled(true);
+                cell.tree->build(pending[i].begin(), pending[i].end());
+                tree_count++;
+            }
+            else {
+                cell.bucket.reserve(pending[i].size());
+
+                for (const ObjectPtr& object : pending[i])
+                    cell.bucket.push_back(Entry{ object->bounds, object });
+            }
+        }
+
+        total_count = objects.size();
+        return total_count;
+    }
+
+    template<typename T, size_t _Capacity>
+    template<typename _Visitor>
+    inline bool QuadTreeGrid<T, _Capacity>::query(const QuadTreeAABB<T>& _Boundaries, _Visitor&& _Func) const
+    {
+        if (total_count == 0)
+            return true;
+
+        // an object is filed by its top left corner, which lies at most
+        // the largest extent to the left or above the query
+        const size_t first_column = column(static_cast<Scalar>(_Boundaries.left) - max_width);
+        const size_t last_column = column(static_cast<Scalar>(_Boundaries.right));
+        const size_t first_row = row(static_cast<Scalar>(_Boundaries.top) - max_height);
+        const size_t last_row = row(static_cast<Scalar>(_Boundaries.bottom));
+
+        for (size_t y = first_row; y <= last_row; y++) {
+            for (size_t x = first_column; x <= last_column; x++) {
+                const Cell& cell = cells[y * columns + x];
+
+                if (cell.tree) {
+                    if (!cell.tree->query(_Boundaries, _Func))
+                        return false;
+
+                    continue;
+                }
+
+                for (const Entry& entry : cell.bucket) {
+                    if (entry.bounds.intersects(_Boundaries) && !call_visitor(_Func, entry.object))
+                        return false;
+                }
+            }
+        }
+
+        return true;
+    }
+} // namespace nc
+
+#endif // NC_QUADTREE_GRID_H_
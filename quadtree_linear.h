@@ -0,0 +1,362 @@
+// ================================= //
+//                                   //
+// QuadTree Version 0.1a             //
+// Copyright (c) 2017 NuclearC       //
+//                                   //
+// ================================= //
+
+// quadtree_linear.h: linear quadtree over morton keys
+
+#ifndef NC_QUADTREE_LINEAR_H_
+#define NC_QUADTREE_LINEAR_H_
+
+#include "quadtree.h"
+
+namespace nc {
+    // linear quadtree, an alternative storage backend with the object and
+    // query interface of QuadTree. coordinates are quantized to a grid of
+    // 2^kDepth cells per axis and every object is filed under the smallest
+    // grid cell that contains it. each level keeps its objects in one array
+    // sorted by the z-order key of their cell, so there are no nodes at
+    // all. a query walks the keys of the cells it covers on every level
+    // and jumps over the z-order runs that leave the query
+    template <typename T = double>
+    class QuadTreeLinear {
+    public:
+        using Object = QuadTreeObject<T>;
+        using ObjectPtr = std::shared_ptr<Object>;
+
+        // cells per axis on the deepest level are 2^kDepth
+        static constexpr uint32_t kDepth = 16;
+    private:
+        struct Entry {
+            uint64_t code;
+            QuadTreeAABB<T> bounds;
+            ObjectPtr object;
+
+            bool operator<(const Entry& _Other) const { return code < _Other.code; }
+        };
+
+        // a single key, compares against an entry in searches
+        struct Key {
+            uint64_t code;
+
+            bool operator<(const Entry& _Entry) const { return code < _Entry.code; }
+            friend bool operator<(const Entry& _Entry, const Key& _Key) { return _Entry.code < _Key.code; }
+        };
+
+        // the grid cell range of some bounds on the deepest level
+        struct Cells {
+            uint32_t left, top, right, bottom;
+        };
+
+        QuadTreeAABB<T> bounds;
+
+        // one sorted array per level, level 0 is the whole space
+        std::array<std::vector<Entry>, kDepth + 1> levels;
+        size_t total_count = 0;
+
+        Cells quantize(const QuadTreeAABB<T>& _Bounds) const;
+
+        // level and key of the smallest cell holding _Bounds
+        void locate(const QuadTreeAABB<T>& _Bounds, size_t& _Level, uint64_t& _Code) const;
+
+        // smallest key inside the rectangle [_Min, _Max] that is larger
+        // than _Code, for a _Code between the two that lies outside it
+        static uint64_t next_inside(uint64_t _Code, uint64_t _Min, uint64_t _Max, size_t _Bits);
+
+        static bool inside(uint64_t _Code, uint64_t _Min, uint64_t _Max) {
+            const uint64_t x = 0x5555555555555555ull, y = 0xAAAAAAAAAAAAAAAAull;
+
+            return (_Code & x) >= (_Min & x) && (_Code & x) <= (_Max & x) &&
+                (_Code & y) >= (_Min & y) && (_Code & y) <= (_Max & y);
+        }
+
+        template <typename _Visitor>
+        bool query(size_t _Level, const Cells& _Cells, const QuadTreeAABB<T>& _Bounds, _Visitor& _Func) const;
+    public:
+        QuadTreeLinear() {}
+
+        QuadTreeLinear(const QuadTreeAABB<T>& _Bounds) : bounds(_Bounds) {}
+
+        // the objects have to be inserted again after the space changes
+        void set_bounds(const QuadTreeAABB<T>& _Bounds) {
+            clear();
+            bounds = _Bounds;
+        }
+
+        const QuadTreeAABB<T>& get_bounds() const { return bounds; }
+
+        void clear() {
+            for (std::vector<Entry>& level : levels)
+                level.clear();
+
+            total_count = 0;
+        }
+
+        // a binary search and an insert into the array of the level, so
+        // large sets should be loaded with build()
+        bool insert(const ObjectPtr& _Object);
+
+        bool remove(const ObjectPtr& _Object);
+
+        // moves _Object to _Bounds, in place while it keeps its cell
+        bool update(const ObjectPtr& _Object, const QuadTreeAABB<T>& _Bounds);
+
+        // replaces the contents with [_Begin, _End), objects outside the
+        // space are skipped. returns the number of objects stored
+        template <typename _Iterator>
+        size_t build(_Iterator _Begin, _Iterator _End);
+
+        void query(const QuadTreeAABB<T>& _Boundaries, ObjectPtr* _Objects, size_t& _Length) const {
+            auto append = [&](const ObjectPtr& _Object) { _Objects[_Length++] = _Object; };
+            query(_Boundaries, append);
+        }
+
+        void query(const QuadTreeAABB<T>& _Boundaries, std::vector<ObjectPtr>& _Objects) const {
+            auto append = [&](const ObjectPtr& _Object) { _Objects.push_back(_Object); };
+            query(_Boundaries, append);
+        }
+
+        // calls _Func(const ObjectPtr&) for every object intersecting
+        // _Boundaries. if _Func returns a bool, false stops the query.
+        // returns false if it was stopped early
+        template <typename _Visitor>
+        bool query(const QuadTreeAABB<T>& _Boundaries, _Visitor&& _Func) const;
+
+        size_t get_total_objects() const { return total_count; }
+
+        // objects filed on _Level
+        size_t get_level_objects(size_t _Level) const { return levels[_Level].size(); }
+    };
+
+    template<typename T>
+    inline typename QuadTreeLinear<T>::Cells QuadTreeLinear<T>::quantize(const QuadTreeAABB<T>& _Bounds) const
+    {
+        // morton::quantize is monotone, so an object and a query that
+        // intersect always share at least one cell
+        const uint32_t shift = 32 - kDepth;
+
+        return {
+            morton::quantize(_Bounds.left, bounds.left, bounds.right) >> shift,
+            morton::quantize(_Bounds.top, bounds.top, bounds.bottom) >> shift,
+            morton::quantize(_Bounds.right, bounds.left, bounds.right) >> shift,
+            morton::quantize(_Bounds.bottom, bounds.top, bounds.bottom) >> shift
+        };
+    }
+
+    template<typename T>
+    inline void QuadTreeLinear<T>::locate(const QuadTreeAABB<T>& _Bounds, size_t& _Level, uint64_t& _Code) const
+    {
+        Cells cells = quantize(_Bounds);
+
+        // the cell is the common prefix of both corners
+        uint32_t differ = (cells.left ^ cells.right) | (cells.top ^ cells.bottom);
+        uint32_t shift = 0;
+
+        while (differ >> shift)
+            shift++;
+
+        _Level = kDepth - shift;
+        _Code = morton::encode(cells.left >> shift, cells.top >> shift);
+    }
+
+    template<typename T>
+    inline uint64_t QuadTreeLinear<T>::next_inside(uint64_t _Code, uint64_t _Min, uint64_t _Max, size_t _Bits)
+    {
+        // bigmin of Tropf and Herzog, walks the key from the top bit and
+        // narrows the rectangle to the half the next key has to be in
+        const uint64_t x = 0x5555555555555555ull;
+        uint64_t result = _Max;
+
+        for (size_t bit = _Bits; bit-- > 0;) {
+            const uint64_t mask = uint64_t(1) << bit;
+            // the lower bits on the same axis as this one
+            const uint64_t lower = ((bit & 1) ? ~x : x) & (mask - 1);
+
+            bool code = (_Code & mask) != 0;
+            bool low = (_Min & mask) != 0;
+            bool high = (_Max & mask) != 0;
+
+            if (!code && !low && high) {
+                // the answer is the start of the upper half, unless a key
+                // in the lower half follows
+                result = (_Min | mask) & ~lower;
+                _Max = (_Max & ~mask) | lower;
+            }
+            else if (!code && low && high) {
+                return _Min;
+            }
+            else if (code && !low && !high) {
+                return result;
+            }
+            else if (code && !low && high) {
+                _Min = (_Min | mask) & ~lower;
+            }
+        }
+
+        return result;
+    }
+
+    template<typename T>
+    inline bool QuadTreeLinear<T>::insert(const ObjectPtr& _Object)
+    {
+        if (!bounds.intersects(_Object->bounds))
+            return false;
+
+        size_t level;
+        uint64_t code;
+
+        locate(_Object->bounds, level, code);
+
+        std::vector<Entry>& entries = levels[level];
+        auto it = std::upper_bound(entries.begin(), entries.end(), Key{ code });
+
+        entries.insert(it, Entry{ code, _Object->bounds, _Object });
+        total_count++;
+        return true;
+    }
+
+    template<typename T>
+    inline bool QuadTreeLinear<T>::remove(const ObjectPtr& _Object)
+    {
+        size_t level;
+        uint64_t code;
+
+        locate(_Object->bounds, level, code);
+
+        std::vector<Entry>& entries = levels[level];
+        auto range = std::equal_range(entries.begin(), entries.end(), Key{ code });
+
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->object == _Object) {
+                entries.erase(it);
+                total_count--;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    template<typename T>
+    inline bool QuadTreeLinear<T>::update(const ObjectPtr& _Object, const QuadTreeAABB<T>& _Bounds)
+    {
+        if (!bounds.intersects(_Bounds))
+            return false;
+
+        size_t level, new_level;
+        uint64_t code, new_code;
+
+        locate(_Object->bounds, level, code);
+        locate(_Bounds, new_level, new_code);
+
+        if (level == new_level && code == new_code) {
+            std::vector<Entry>& entries = levels[level];
+            auto range = std::equal_range(entries.begin(), entries.end(), Key{ code });
+
+            for (auto it = range.first; it != range.second; ++it) {
+                if (it->object == _Object) {
+                    it->bounds = _Bounds;
+                    _Object->bounds = _Bounds;
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        if (!remove(_Object))
+            return false;
+
+        _Object->bounds = _Bounds;
+        return insert(_Object);
+    }
+
+    template<typename T>
+    template<typename _Iterator>
+    inline size_t QuadTreeLinear<T>::build(_Iterator _Begin, _Iterator _End)
+    {
+        clear();
+
+        for (; _Begin != _End; ++_Begin) {
+            const ObjectPtr& object = *_Begin;
+
+            if (!object || !bounds.intersects(object->bounds))
+                continue;
+
+            size_t level;
+            uint64_t code;
+
+            locate(object->bounds, level, code);
+            levels[level].push_back(Entry{ code, object->bounds, object });
+            total_count++;
+        }
+
+        // stable so objects in one cell keep their input order, as with
+        // inserting them one by one
+        for (std::vector<Entry>& entries : levels)
+            std::stable_sort(entries.begin(), entries.end());
+
+        return total_count;
+    }
+
+    template<typename T>
+    template<typename _Visitor>
+    inline bool QuadTreeLinear<T>::query(const QuadTreeAABB<T>& _Boundaries, _Visitor&& _Func) const
+    {
+        if (!bounds.intersects(_Boundaries))
+            return true;
+
+        Cells cells = quantize(_Boundaries);
+
+        for (size_t level = 0; level <= kDepth; level++) {
+            if (!levels[level].empty() && !query(level, cells, _Boundaries, _Func))
+                return false;
+        }
+
+        return true;
+    }
+
+    template<typename T>
+    template<typename _Visitor>
+    inline bool QuadTreeLinear<T>::query(size_t _Level, const Cells& _Cells, const QuadTreeAABB<T>& _Bounds,
+        _Visitor& _Func) const
+    {
+        const std::vector<Entry>& entries = levels[_Level];
+        const uint32_t shift = static_cast<uint32_t>(kDepth - _Level);
+
+        const uint64_t min = morton::encode(_Cells.left >> shift, _Cells.top >> shift);
+        const uint64_t max = morton::encode(_Cells.right >> shift, _Cells.bottom >> shift);
+
+        auto it = std::lower_bound(entries.begin(), entries.end(), Key{ min });
+
+        while (it != entries.end() && it->code <= max) {
+            if (!inside(it->code, min, max)) {
+                // skip the run of keys the z-order curve spends outside,
+                // galloping since the next key inside is usually close
+                Key next = { next_inside(it->code, min, max, 2 * _Level) };
+                size_t step = 1;
+                auto last = it;
+
+                while (static_cast<size_t>(entries.end() - last) > step && last[step].code < next.code) {
+                    last += step;
+                    step *= 2;
+                }
+
+                last = static_cast<size_t>(entries.end() - last) > step ? last + step + 1 : entries.end();
+                it = std::lower_bound(it, last, next);
+                continue;
+            }
+
+            if (it->bounds.intersects(_Bounds) && !call_visitor(_Func, it->object))
+                return false;
+
+            ++it;
+        }
+
+        return true;
+    }
+} // namespace nc
+
+#endif // NC_QUADTREE_LINEAR_H_
@@ -0,0 +1,103 @@
+// ================================= //
+//                                   //
+// QuadTree Version 0.1a             //
+// Copyright (c)2017 NuclearC        //
+//                                   //
+// ================================= //
+
+// build() on one and on several threads against a scan of the input,
+// with clustered and spread out objects, some across or beyond the root
+// edge. both builds have to give the same tree, and the tree has to
+// allow the usual mutations afterwards
+
+#include "../quadtree.h"
+#include "check.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace {
+    using Tree = nc::QuadTree<double, 8>;
+    using ObjectPtr = Tree::ObjectPtr;
+    using Box = nc::QuadTreeAABB<double>;
+
+    std::vector<size_t> query_ids(const Tree& _Tree, const Box& _Bounds) {
+        std::vector<size_t> ids;
+        _Tree.query(_Bounds, [&](const ObjectPtr& _Object) { ids.push_back(_Object->id); });
+
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    }
+
+    std::vector<size_t> brute_force(const std::vector<ObjectPtr>& _Objects, const Box& _Root, const Box& _Bounds) {
+        std::vector<size_t> ids;
+
+        for (const ObjectPtr& object : _Objects) {
+            if (_Root.intersects(object->bounds) && object->bounds.intersects(_Bounds))
+                ids.push_back(object->id);
+        }
+
+        return ids;
+    }
+}
+
+int main() {
+    const Box root(0, 0, 1000, 1000);
+
+    std::mt19937 random(4);
+    std::uniform_real_distribution<double> spread(-20, 1010), clustered(300, 340), extent(0.5, 8);
+    std::vector<ObjectPtr> objects;
+    size_t inside = 0;
+
+    for (size_t i = 0; i < 120000; i++) {
+        const double x = i % 2 ? clustered(random) : spread(random);
+        const double y = i % 2 ? clustered(random) : spread(random);
+        const Box bounds(x, y, x + extent(random), y + extent(random));
+
+        objects.push_back(std::make_shared<Tree::Object>(bounds, nullptr, i));
+        inside += root.intersects(bounds);
+    }
+
+    Tree serial(root), parallel(root);
+
+    CHECK(serial.build(objects.begin(), objects.end()) == inside);
+    CHECK(parallel.build(objects.begin(), objects.end(), 4) == inside);
+    CHECK(parallel.get_total_objects() == inside);
+
+    std::vector<uint8_t> serial_data, parallel_data;
+    serial.serialize(serial_data);
+    parallel.serialize(parallel_data);
+    CHECK(serial_data == parallel_data);
+
+    for (int q = 0; q < 60; q++) {
+        const double x = spread(random), y = spread(random), size = q % 2 ? 10 : 200;
+        const Box query(x, y, x + size, y + size);
+        CHECK(query_ids(parallel, query) == brute_force(objects, root, query));
+    }
+
+    CHECK(query_ids(parallel, root) == brute_force(objects, root, root));
+
+    // remove and update on the built tree
+    for (size_t i = 0; i < objects.size(); i += 7) {
+        if (!root.intersects(objects[i]->bounds))
+            continue;
+
+        if (i % 2) {
+            CHECK(parallel.remove(objects[i]));
+            objects[i]->bounds = Box(-100, -100, -99, -99);
+        }
+        else {
+            CHECK(parallel.update(objects[i], Box(500, 500, 501, 501)));
+        }
+    }
+
+    CHECK(query_ids(parallel, root) == brute_force(objects, root, root));
+    CHECK(query_ids(parallel, Box(499, 499, 502, 502)) == brute_force(objects, root, Box(499, 499, 502, 502)));
+
+    // building again replaces the contents
+    CHECK(parallel.build(objects.begin(), objects.begin() + 1000, 4) <= 1000);
+    CHECK(parallel.get_total_objects() == query_ids(parallel, root).size());
+
+    return nc_test::finish("build_test");
+}
@@ -0,0 +1,43 @@
+// ================================= //
+//                                   //
+// QuadTree Version 0.1a             //
+// Copyright (c)2017 NuclearC        //
+//                                   //
+// ================================= //
+
+// shared by the test programs. a failed CHECK prints where it failed and
+// the program returns 1 from finish(), every check still runs. checks
+// may fail on several threads at once
+
+#ifndef NC_QUADTREE_TESTS_CHECK_H_
+#define NC_QUADTREE_TESTS_CHECK_H_
+
+#include <atomic>
+#include <cstdio>
+
+namespace nc_test {
+    inline std::atomic<int>& failures() {
+        static std::atomic<int> count(0);
+        return count;
+    }
+
+    inline void fail(const char* _File, int _Line, const char* _Expression) {
+        if (failures()++ < 20)
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", _File, _Line, _Expression);
+    }
+
+    inline int finish(const char* _Name) {
+        if (failures() > 0) {
+            std::printf("%s: %d checks failed\n", _Name, failures().load());
+            return 1;
+        }
+
+        std::printf("%s: ok\n", _Name);
+        return 0;
+    }
+} // namespace nc_test
+
+#define CHECK(_Condition) \
+    ((_Condition) ? (void)0 : ::nc_test::fail(__FILE__, __LINE__, #_Condition))
+
+#endif // NC_QUADTREE_TESTS_CHECK_H_
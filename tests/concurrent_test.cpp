@@ -0,0 +1,153 @@
+// ================================= //
+//                                   //
+// QuadTree Version 0.1a             //
+// Copyright (c)2017 NuclearC        //
+//                                   //
+// ================================= //
+
+// QuadTreeConcurrent with a writer doing random inserts, removes and
+// updates while two readers query snapshots. every published snapshot
+// is compared with a scan of the live objects, and a snapshot kept from
+// before a round of updates has to keep answering as it did. meant to
+// be built with -fsanitize=thread as well
+
+#include "../quadtree.h"
+#include "check.h"
+
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+    using Concurrent = nc::QuadTreeConcurrent<double, 4>;
+    using Tree = Concurrent::Tree;
+    using ObjectPtr = Tree::ObjectPtr;
+    using Box = nc::QuadTreeAABB<double>;
+
+    std::vector<size_t> snapshot_ids(const Tree& _Tree, const Box& _Bounds) {
+        std::vector<size_t> ids;
+        _Tree.query(_Bounds, [&](const ObjectPtr& _Object) { ids.push_back(_Object->id); });
+
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    }
+
+    std::vector<size_t> brute_force(const std::vector<ObjectPtr>& _Objects, const Box& _Bounds) {
+        std::vector<size_t> ids;
+
+        for (const ObjectPtr& object : _Objects) {
+            if (object->bounds.intersects(_Bounds))
+                ids.push_back(object->id);
+        }
+
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    }
+}
+
+int main() {
+    std::mt19937 random(3);
+    std::uniform_real_distribution<double> position(0, 990);
+
+    auto make_box = [&]() {
+        const double x = position(random), y = position(random);
+        return Box(x, y, x + 3, y + 3);
+    };
+
+    Concurrent concurrent(Box(0, 0, 1000, 1000));
+    concurrent.writer().set_index_enabled(true);
+
+    std::vector<ObjectPtr> live;
+
+    for (size_t i = 0; i < 4000; i++)
+        live.push_back(std::make_shared<Tree::Object>(make_box(), nullptr, i));
+
+    concurrent.writer().build(live.begin(), live.end());
+    concurrent.publish();
+
+    std::atomic<bool> stop(false);
+
+    auto reader = [&]() {
+        const Box everything(0, 0, 1000, 1000);
+
+        while (!stop) {
+            Concurrent::Snapshot snapshot = concurrent.snapshot();
+            const std::vector<size_t> ids = snapshot_ids(*snapshot, everything);
+
+            CHECK(ids.size() == snapshot->get_total_objects());
+            CHECK(snapshot_ids(*snapshot, everything) == ids);
+        }
+    };
+
+    std::thread first(reader), second(reader);
+    size_t next_id = live.size();
+
+    for (int round = 0; round < 150; round++) {
+        Concurrent::Snapshot before = concurrent.snapshot();
+        const Box probe(position(random), position(random), 1000, 1000);
+        const std::vector<size_t> probe_ids = snapshot_ids(*before, probe);
+
+        for (int k = 0; k < 30; k++) {
+            const size_t i = random() % live.size();
+
+            switch (random() % 4) {
+            case 0: {
+                ObjectPtr copy = concurrent.update(live[i], make_box());
+                CHECK(copy && copy != live[i] && copy->id == live[i]->id);
+
+                if (copy)
+                    live[i] = copy;
+                break;
+            }
+            case 1: {
+                // two updates of the same object, the second one applies to
+                // the copy the first one made
+                std::vector<Concurrent::Operation> operations;
+                operations.push_back({ Tree::OperationType::Update, live[i], make_box() });
+                operations.push_back({ Tree::OperationType::Update, live[i], make_box() });
+
+                const Box old_bounds = live[i]->bounds;
+                const Box new_bounds = operations[1].bounds;
+
+                CHECK(concurrent.apply(operations) == 2);
+                CHECK(operations[1].object != live[i] && operations[1].object->bounds == new_bounds);
+                CHECK(live[i]->bounds == old_bounds);
+
+                live[i] = operations[1].object;
+                break;
+            }
+            case 2:
+                CHECK(concurrent.remove(live[i]));
+                live[i] = live.back();
+                live.pop_back();
+                break;
+            default:
+                live.push_back(std::make_shared<Tree::Object>(make_box(), nullptr, next_id++));
+                CHECK(concurrent.insert(live.back()));
+                break;
+            }
+        }
+
+        Concurrent::Snapshot snapshot = concurrent.publish();
+        CHECK(snapshot->get_total_objects() == live.size());
+
+        for (int q = 0; q < 4; q++) {
+            const double x = position(random), y = position(random);
+            const Box query(x, y, x + 100, y + 100);
+            CHECK(snapshot_ids(*snapshot, query) == brute_force(live, query));
+        }
+
+        for (size_t j = 0; j < live.size(); j += 97)
+            CHECK(snapshot->find(live[j]->id) == live[j]);
+
+        CHECK(snapshot_ids(*before, probe) == probe_ids);
+    }
+
+    stop = true;
+    first.join();
+    second.join();
+
+    return nc_test::finish("concurrent_test");
+}
@@ -0,0 +1,138 @@
+// ================================= //
+//                                   //
+// QuadTree Version 0.1a             //
+// Copyright (c)2017 NuclearC        //
+//                                   //
+// ================================= //
+
+// query cursors against query() for chunked, paused and time budgeted
+// runs, over a depth limited tree so leaves overflow. a mutation of the
+// tree has to mark a cursor stale and make it throw
+
+#include "../quadtree.h"
+#include "check.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    using Tree = nc::QuadTree<double, 4>;
+    using ObjectPtr = Tree::ObjectPtr;
+    using Box = nc::QuadTreeAABB<double>;
+
+    std::vector<size_t> sorted_ids(const std::vector<ObjectPtr>& _Objects) {
+        std::vector<size_t> ids;
+
+        for (const ObjectPtr& object : _Objects)
+            ids.push_back(object->id);
+
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    }
+}
+
+int main() {
+    Tree tree(Box(0, 0, 1000, 1000));
+
+    nc::QuadTreeSplitPolicy<double> policy;
+    policy.max_depth = 3;
+    tree.set_split_policy(policy);
+
+    std::mt19937 random(5);
+    std::uniform_real_distribution<double> position(0, 990);
+    std::vector<ObjectPtr> objects;
+
+    for (size_t i = 0; i < 15000; i++) {
+        const double x = position(random), y = position(random);
+        objects.push_back(std::make_shared<Tree::Object>(Box(x, y, x + 4, y + 4), nullptr, i));
+        tree.insert(objects.back());
+    }
+
+    for (int q = 0; q < 60; q++) {
+        const double x = position(random) / 2, y = position(random) / 2;
+        const Box query(x, y, x + 300, y + 300);
+
+        std::vector<ObjectPtr> expected;
+        tree.query(query, expected);
+
+        // fixed size chunks
+        Tree::QueryCursor cursor = tree.query_cursor(query);
+        std::vector<ObjectPtr> result;
+        const size_t chunk = 1 + q * 7;
+
+        while (!cursor.done()) {
+            const size_t before = result.size();
+            const size_t count = cursor.next(result, chunk);
+
+            CHECK(count <= chunk && count == result.size() - before);
+        }
+
+        CHECK(cursor.next(result) == 0);
+        CHECK(!cursor.stale());
+        CHECK(sorted_ids(result) == sorted_ids(expected));
+
+        // the visitor pauses after every object
+        cursor = tree.query_cursor(query);
+        result.clear();
+
+        while (!cursor.done()) {
+            const size_t count = cursor.next([&](const ObjectPtr& _Object) {
+                result.push_back(_Object);
+                return false;
+            });
+
+            CHECK(count <= 1);
+        }
+
+        CHECK(sorted_ids(result) == sorted_ids(expected));
+    }
+
+    // even a zero budget makes progress every call
+    Tree::QueryCursor cursor = tree.query_cursor(tree.get_bounds());
+    std::vector<ObjectPtr> result;
+    size_t calls = 0;
+
+    while (!cursor.done() && calls < objects.size()) {
+        cursor.next(result, std::numeric_limits<size_t>::max(), Tree::QueryCursor::Clock::duration::zero());
+        calls++;
+    }
+
+    CHECK(cursor.done());
+    CHECK(sorted_ids(result) == sorted_ids(objects));
+
+    // mutating the tree invalidates an open cursor
+    cursor = tree.query_cursor(tree.get_bounds());
+    cursor.next(result, 10);
+    CHECK(!cursor.stale());
+
+    CHECK(tree.update(objects[0], Box(1, 1, 2, 2)));
+    CHECK(cursor.stale());
+
+    bool thrown = false;
+
+    try {
+        cursor.next(result, 10);
+    }
+    catch (const std::logic_error&) {
+        thrown = true;
+    }
+
+    CHECK(thrown);
+
+    // a fresh cursor after the change is fine
+    cursor = tree.query_cursor(Box(0, 0, 3, 3));
+    result.clear();
+    cursor.next(result);
+    CHECK(cursor.done() && !cursor.stale());
+    CHECK(std::find(result.begin(), result.end(), objects[0]) != result.end());
+
+    Tree::QueryCursor empty;
+    CHECK(empty.done() && !empty.stale());
+    CHECK(empty.next(result) == 0);
+
+    return nc_test::finish("cursor_test");
+}
@@ -0,0 +1,111 @@
+// ================================= //
+//                                   //
+// QuadTree Version 0.1a             //
+// Copyright (c)2017 NuclearC        //
+//                                   //
+// ================================= //
+
+// QuadTreeFrozen against a scan of the objects left in the tree it was
+// frozen from, for box and circle queries and for int, float and double
+// trees. freezing an empty tree and stopping a query early are covered
+// too
+
+#include "../quadtree.h"
+#include "check.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace {
+    template <typename T>
+    using ObjectPtr = std::shared_ptr<nc::QuadTreeObject<T>>;
+
+    template <typename T>
+    std::vector<size_t> sorted_ids(const std::vector<ObjectPtr<T>>& _Objects) {
+        std::vector<size_t> ids;
+
+        for (const ObjectPtr<T>& object : _Objects)
+            ids.push_back(object->id);
+
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    }
+
+    template <typename T, typename _Shape>
+    std::vector<size_t> brute_force(const std::vector<ObjectPtr<T>>& _Objects, const _Shape& _Query) {
+        std::vector<size_t> ids;
+
+        for (const ObjectPtr<T>& object : _Objects) {
+            if (object && _Query.intersects(object->bounds))
+                ids.push_back(object->id);
+        }
+
+        return ids;
+    }
+
+    template <typename T>
+    void check_type() {
+        nc::QuadTree<T, 8> tree(nc::QuadTreeAABB<T>(0, 0, 1000, 1000));
+
+        CHECK(tree.freeze().get_total_objects() == 0);
+
+        std::mt19937 random(1);
+        std::uniform_int_distribution<int> position(1, 980);
+        std::vector<ObjectPtr<T>> objects;
+
+        for (size_t i = 0; i < 12000; i++) {
+            const T x = T(position(random)), y = T(position(random));
+            objects.push_back(std::make_shared<nc::QuadTreeObject<T>>(nc::QuadTreeAABB<T>(x, y, x + 3, y + 3), nullptr, i));
+            tree.insert(objects.back());
+        }
+
+        // removed objects must not show up in the frozen tree
+        for (size_t i = 0; i < objects.size(); i += 3) {
+            tree.remove(objects[i]);
+            objects[i] = nullptr;
+        }
+
+        const nc::QuadTreeFrozen<T> frozen = tree.freeze();
+        CHECK(frozen.get_total_objects() == tree.get_total_objects());
+
+        for (int q = 0; q < 200; q++) {
+            const T x = T(position(random)), y = T(position(random));
+            const nc::QuadTreeAABB<T> box(x, y, x + 40, y + 40);
+            const nc::QuadTreeCircle<T> circle(x, y, 25);
+
+            std::vector<ObjectPtr<T>> result;
+            frozen.query(box, result);
+            CHECK(sorted_ids(result) == brute_force(objects, box));
+
+            result.clear();
+            frozen.query(circle, result);
+            CHECK(sorted_ids(result) == brute_force(objects, circle));
+
+            size_t calls = 0;
+            const size_t hits = brute_force(objects, box).size();
+            CHECK(frozen.query(box, [&](const ObjectPtr<T>&) { return ++calls < 2; }) == (hits < 2));
+            CHECK(calls == std::min<size_t>(2, hits));
+        }
+
+        // the frozen tree keeps its objects when the tree drops them
+        for (const ObjectPtr<T>& object : objects) {
+            if (object)
+                tree.remove(object);
+        }
+
+        CHECK(tree.get_total_objects() == 0);
+
+        std::vector<ObjectPtr<T>> result;
+        frozen.query(nc::QuadTreeAABB<T>(0, 0, 1000, 1000), result);
+        CHECK(result.size() == frozen.get_total_objects());
+    }
+}
+
+int main() {
+    check_type<int>();
+    check_type<float>();
+    check_type<double>();
+
+    return nc_test::finish("frozen_test");
+}
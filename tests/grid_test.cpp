@@ -0,0 +1,179 @@
+// ================================= //
+//                                   //
+// QuadTree Version 0.1a             //
+// Copyright (c)2017 NuclearC        //
+//                                   //
+// ================================= //
+
+// QuadTreeGrid against a scan of its live objects, with a dense cluster
+// whose cells turn into trees next to sparse cells, objects reaching out
+// of the space and random inserts, removes and updates. also the
+// resolution chosen for a very wide space and the resolution limit
+
+#include "../quadtree_grid.h"
+#include "check.h"
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    template <typename T>
+    void check_type(bool _Build) {
+        using Grid = nc::QuadTreeGrid<T, 8>;
+        using ObjectPtr = typename Grid::ObjectPtr;
+        using Box = nc::QuadTreeAABB<T>;
+
+        Grid grid(Box(0, 0, 10000, 10000), 8, 8);
+
+        std::mt19937 random(2);
+        std::uniform_real_distribution<double> anywhere(-500, 10500), cluster(4000, 4400), extent(1, 60);
+
+        auto make_box = [&](size_t _Index) {
+            const double x = _Index % 3 ? cluster(random) : anywhere(random);
+            const double y = _Index % 3 ? cluster(random) : anywhere(random);
+            const double size = extent(random);
+            return Box(T(x), T(y), T(x + size), T(y + size / 2 + 1));
+        };
+
+        std::vector<ObjectPtr> objects;
+        std::vector<bool> live;
+
+        for (size_t i = 0; i < 12000; i++) {
+            objects.push_back(std::make_shared<nc::QuadTreeObject<T>>(make_box(i), nullptr, i));
+            live.push_back(true);
+
+            if (!_Build)
+                CHECK(grid.insert(objects.back()));
+        }
+
+        if (_Build)
+            CHECK(grid.build(objects.begin(), objects.end()) == objects.size());
+
+        CHECK(grid.get_tree_cells() > 0);
+
+        auto check_queries = [&]() {
+            for (int q = 0; q < 100; q++) {
+                const double x = anywhere(random), y = anywhere(random), size = extent(random) * 5;
+                Box query(T(x), T(y), T(x + size), T(y + size));
+
+                if (q % 4 == 0)
+                    query = Box(T(cluster(random)), T(cluster(random)), T(4500), T(4500));
+
+                std::vector<ObjectPtr> result;
+                grid.query(query, result);
+
+                std::vector<size_t> ids, expected;
+
+                for (const ObjectPtr& object : result)
+                    ids.push_back(object->id);
+
+                for (size_t k = 0; k < objects.size(); k++) {
+                    if (live[k] && objects[k]->bounds.intersects(query))
+                        expected.push_back(k);
+                }
+
+                std::sort(ids.begin(), ids.end());
+                CHECK(ids == expected);
+            }
+        };
+
+        check_queries();
+
+        for (int step = 0; step < 20000; step++) {
+            const size_t i = random() % objects.size();
+
+            if (!live[i]) {
+                CHECK(grid.insert(objects[i]));
+                live[i] = true;
+            }
+            else if (random() % 3 == 0) {
+                CHECK(grid.remove(objects[i]));
+                CHECK(!grid.remove(objects[i]));
+                live[i] = false;
+            }
+            else {
+                CHECK(grid.update(objects[i], make_box(i)));
+            }
+        }
+
+        const size_t count = size_t(std::count(live.begin(), live.end(), true));
+        CHECK(grid.get_total_objects() == count);
+        check_queries();
+
+        grid.set_resolution(3, 5);
+        CHECK(grid.get_columns() == 3 && grid.get_rows() == 5);
+        CHECK(grid.get_total_objects() == count);
+        check_queries();
+
+        // a resolution over the limit leaves the grid as it was
+        bool thrown = false;
+
+        try {
+            grid.set_resolution(size_t(1) << 30, 4);
+        }
+        catch (const std::invalid_argument&) {
+            thrown = true;
+        }
+
+        CHECK(thrown);
+        CHECK(grid.get_columns() == 3 && grid.get_rows() == 5);
+        CHECK(grid.get_total_objects() == count);
+        check_queries();
+
+        // emptying the dense cells turns their trees back into buckets
+        for (size_t k = 0; k < objects.size(); k++) {
+            if (live[k] && k % 5) {
+                CHECK(grid.remove(objects[k]));
+                live[k] = false;
+            }
+        }
+
+        check_queries();
+
+        // flat boxes are turned away
+        CHECK(!grid.insert(std::make_shared<nc::QuadTreeObject<T>>(Box(5, 5, 5, 9), nullptr, 999999)));
+    }
+
+    // a space a billion times wider than high still gets a bounded grid
+    void check_wide() {
+        using Grid = nc::QuadTreeGrid<double>;
+
+        Grid grid(nc::QuadTreeAABB<double>(0, 0, 1e9, 1));
+        std::vector<Grid::ObjectPtr> objects;
+
+        std::mt19937 random(1);
+        std::uniform_real_distribution<double> position(0, 1e9 - 10);
+
+        for (size_t i = 0; i < 50000; i++) {
+            const double x = position(random);
+            objects.push_back(std::make_shared<Grid::Object>(nc::QuadTreeAABB<double>(x, 0.2, x + 5, 0.6), nullptr, i));
+        }
+
+        CHECK(grid.build(objects.begin(), objects.end()) == objects.size());
+        CHECK(grid.get_columns() * grid.get_rows() <= Grid::kMaxCells);
+        CHECK(grid.get_rows() >= 1);
+
+        std::vector<Grid::ObjectPtr> result;
+        grid.query(nc::QuadTreeAABB<double>(0, 0, 1e9, 1), result);
+        CHECK(result.size() == objects.size());
+
+        // and the same standing up, without objects
+        Grid tall(nc::QuadTreeAABB<double>(0, 0, 1, 1e9));
+        CHECK(tall.build(objects.begin(), objects.begin()) == 0);
+        CHECK(tall.get_columns() >= 1 && tall.get_rows() >= 1);
+    }
+}
+
+int main() {
+    for (int build = 0; build < 2; build++) {
+        check_type<double>(build != 0);
+        check_type<float>(build != 0);
+        check_type<int32_t>(build != 0);
+    }
+
+    check_wide();
+
+    return nc_test::finish("grid_test");
+}
@@ -0,0 +1,227 @@
+// ================================= //
+//                                   //
+// QuadTree Version 0.1a             //
+// Copyright (c)2017 NuclearC        //
+//                                   //
+// ================================= //
+
+// a tree growing from a tiny root to fit scattered objects, shrinking
+// back with compact() once they are removed and growing again, checked
+// node by node and against a scan of the live objects. flat boxes on the
+// split lines are inserted, moved and removed as well, with both
+// placements and with and without the id index
+
+#include "../quadtree.h"
+#include "check.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace {
+    // levels, parent links, max_bounds and counts of the subtree at _Node,
+    // returns the objects below it
+    template <typename _Tree>
+    size_t check_node(const _Tree& _Target, typename _Tree::NodeIndex _Node, size_t _Level) {
+        const typename _Tree::Node& node = _Target.get_node(_Node);
+        size_t count = node.slot_count();
+
+        CHECK(node.level == _Level);
+
+        for (size_t i = 0; i < node.slot_count(); i++) {
+            const auto bounds = node.get_object_bounds(i);
+
+            CHECK(node.max_bounds.contains(bounds));
+
+            if (_Target.get_placement() == nc::QuadTreePlacement::Contained && _Node != _Target.get_root())
+                CHECK(node.bounds.contains(bounds));
+        }
+
+        if (node.has_children()) {
+            for (typename _Tree::NodeIndex i = 0; i < 4; i++) {
+                const typename _Tree::Node& child = _Target.get_node(node.first_child + i);
+
+                CHECK(child.parent == _Node);
+                CHECK(node.max_bounds.contains(child.max_bounds));
+                count += check_node(_Target, node.first_child + i, _Level + 1);
+            }
+        }
+
+        CHECK(count == node.total_count);
+        return count;
+    }
+
+    template <typename _Tree, typename T>
+    bool matches(const _Tree& _Target, const std::vector<typename _Tree::ObjectPtr>& _Objects,
+        const nc::QuadTreeAABB<T>& _Query)
+    {
+        std::vector<size_t> ids, expected;
+
+        _Target.query(_Query, [&](const typename _Tree::ObjectPtr& _Object) { ids.push_back(_Object->id); });
+
+        for (const auto& object : _Objects) {
+            if (object && object->bounds.intersects(_Query))
+                expected.push_back(object->id);
+        }
+
+        std::sort(ids.begin(), ids.end());
+        std::sort(expected.begin(), expected.end());
+        return ids == expected;
+    }
+
+    template <typename T>
+    void check_grow(bool _Index, bool _Contained, bool _Build) {
+        using Tree = nc::QuadTree<T, 4>;
+        using ObjectPtr = typename Tree::ObjectPtr;
+        using Box = nc::QuadTreeAABB<T>;
+
+        Tree tree(Box(0, 0, 16, 16));
+        tree.set_grow_enabled(true);
+        tree.set_index_enabled(_Index);
+
+        if (_Contained)
+            tree.set_placement(nc::QuadTreePlacement::Contained);
+
+        std::mt19937 random(3);
+        std::uniform_int_distribution<int> position(-50000, 50000);
+        std::vector<ObjectPtr> objects;
+
+        for (size_t i = 0; i < 3000; i++) {
+            const T x = T(position(random)), y = T(position(random) / 3);
+            objects.push_back(std::make_shared<nc::QuadTreeObject<T>>(Box(x, y, x + 5, y + 5), nullptr, i));
+
+            if (!_Build)
+                CHECK(tree.insert(objects.back()));
+        }
+
+        if (_Build)
+            CHECK(tree.build(objects.begin(), objects.end()) == objects.size());
+
+        CHECK(check_node(tree, tree.get_root(), 1) == objects.size());
+        CHECK(tree.get_bounds().contains(Box(-50000, -16667, 50005, 16672)));
+
+        // updates far outside grow the root again
+        for (size_t i = 0; i < 200; i++) {
+            const T x = T(position(random) * 2), y = T(position(random) * 2);
+            CHECK(tree.update(objects[i], Box(x, y, x + 5, y + 5)));
+        }
+
+        check_node(tree, tree.get_root(), 1);
+        CHECK(matches(tree, objects, tree.get_bounds()));
+
+        // keep a small cluster, compact() shrinks the root around it
+        std::vector<ObjectPtr> removed;
+
+        for (ObjectPtr& object : objects) {
+            const Box& b = object->bounds;
+
+            if (b.left > 1000 && b.left < 3000 && b.top > 1000 && b.top < 3000)
+                continue;
+
+            CHECK(tree.remove(object));
+            removed.push_back(object);
+            object = nullptr;
+        }
+
+        const T old_width = tree.get_bounds().right - tree.get_bounds().left;
+        tree.compact();
+
+        CHECK(tree.get_bounds().right - tree.get_bounds().left < old_width);
+        check_node(tree, tree.get_root(), 1);
+
+        for (int q = 0; q < 100; q++) {
+            const T x = T(position(random) / 25 + 2000), y = T(position(random) / 25 + 2000);
+            CHECK(matches(tree, objects, Box(x, y, x + 300, y + 300)));
+        }
+
+        for (size_t i = 0; i < objects.size(); i++)
+            CHECK((tree.find(i) != nullptr) == (objects[i] != nullptr));
+
+        for (const ObjectPtr& object : removed)
+            CHECK(tree.insert(object));
+
+        CHECK(check_node(tree, tree.get_root(), 1) == objects.size());
+    }
+
+    // flat boxes on the split lines of a 100 x 100 root
+    template <typename T>
+    void check_split_lines(bool _Grow, bool _Index, bool _Contained) {
+        using Tree = nc::QuadTree<T, 4>;
+        using ObjectPtr = typename Tree::ObjectPtr;
+        using Box = nc::QuadTreeAABB<T>;
+
+        Tree tree(Box(0, 0, 100, 100));
+        tree.set_grow_enabled(_Grow);
+        tree.set_index_enabled(_Index);
+
+        if (_Contained)
+            tree.set_placement(nc::QuadTreePlacement::Contained);
+
+        std::mt19937 random(1);
+        std::vector<ObjectPtr> objects;
+
+        for (int i = 0; i < 40; i++) {
+            const T x = T(random() % 99), y = T(random() % 99);
+            objects.push_back(std::make_shared<nc::QuadTreeObject<T>>(Box(x, y, x + 1, y + 1), nullptr, objects.size()));
+            tree.insert(objects.back());
+        }
+
+        const T lines[] = { T(50), T(25), T(75), T(12.5), T(37.5) };
+
+        for (T a : lines) {
+            for (T b : lines) {
+                objects.push_back(std::make_shared<nc::QuadTreeObject<T>>(Box(a, b, a, b), nullptr, objects.size()));
+                CHECK(tree.insert(objects.back()));
+
+                objects.push_back(std::make_shared<nc::QuadTreeObject<T>>(Box(a, 10, a, 30), nullptr, objects.size()));
+                CHECK(tree.insert(objects.back()));
+            }
+        }
+
+        CHECK(tree.get_total_objects() == objects.size());
+        CHECK(matches(tree, objects, Box(0, 0, 100, 100)));
+        CHECK(matches(tree, objects, Box(40, 40, 60, 60)));
+
+        for (size_t i = 0; i < objects.size(); i += 2) {
+            const T a = lines[i % 5];
+            CHECK(tree.update(objects[i], Box(a, a, a, a)));
+        }
+
+        CHECK(tree.get_total_objects() == objects.size());
+        CHECK(matches(tree, objects, Box(0, 0, 100, 100)));
+        check_node(tree, tree.get_root(), 1);
+
+        for (const ObjectPtr& object : objects)
+            CHECK(tree.remove(object));
+
+        CHECK(tree.get_total_objects() == 0);
+
+        // the same through build()
+        CHECK(tree.build(objects.begin(), objects.end()) == objects.size());
+        CHECK(matches(tree, objects, Box(0, 0, 100, 100)));
+
+        for (const ObjectPtr& object : objects)
+            CHECK(tree.remove(object));
+    }
+}
+
+int main() {
+    for (int mode = 0; mode < 8; mode++) {
+        const bool index = mode & 1, contained = (mode & 2) != 0, build = (mode & 4) != 0;
+
+        check_grow<double>(index, contained, build);
+        check_grow<float>(index, contained, build);
+        check_grow<int32_t>(index, contained, build);
+
+        check_split_lines<double>(build, index, contained);
+        check_split_lines<float>(build, index, contained);
+        check_split_lines<int32_t>(build, index, contained);
+    }
+
+    // 32 bit coordinates cannot double forever
+    nc::QuadTree<int32_t, 4> tree(nc::QuadTreeAABB<int32_t>(0, 0, 1 << 29, 1 << 29));
+    tree.set_grow_enabled(true);
+    CHECK(!tree.grow(nc::QuadTreeAABB<int32_t>(-2000000000, 0, 10, 10)));
+
+    return nc_test::finish("grow_test");
+}
@@ -0,0 +1,99 @@
+// ================================= //
+//                                   //
+// QuadTree Version 0.1a             //
+// Copyright (c)2017 NuclearC        //
+//                                   //
+// ================================= //
+
+// query_batch() against the plain intersection test for every length up
+// to 40, so each vector kernel runs with all tail lengths. build once as
+// is, once with -mavx2 and once with -DNC_QUADTREE_NO_SIMD
+
+#include "../quadtree.h"
+#include "check.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace {
+    template <typename T>
+    void check_lengths(std::mt19937& _Random) {
+        // a small coordinate range makes equal edges common, the strict
+        // comparisons have to agree on those as well
+        std::uniform_int_distribution<int> coordinate(0, 12);
+        std::uniform_int_distribution<int> extent(0, 4);
+
+        auto box = [&]() {
+            T x = static_cast<T>(coordinate(_Random)), y = static_cast<T>(coordinate(_Random));
+            return nc::QuadTreeAABB<T>(x, y, x + static_cast<T>(extent(_Random)), y + static_cast<T>(extent(_Random)));
+        };
+
+        for (size_t count = 0; count <= 40; count++) {
+            for (int round = 0; round < 200; round++) {
+                std::vector<T> left(count), top(count), right(count), bottom(count);
+                std::vector<nc::QuadTreeAABB<T>> boxes(count);
+
+                for (size_t i = 0; i < count; i++) {
+                    boxes[i] = box();
+                    left[i] = boxes[i].left;
+                    top[i] = boxes[i].top;
+                    right[i] = boxes[i].right;
+                    bottom[i] = boxes[i].bottom;
+                }
+
+                const nc::QuadTreeAABB<T> query = box();
+                std::vector<uint32_t> expected;
+
+                for (size_t i = 0; i < count; i++) {
+                    if (boxes[i].intersects(query))
+                        expected.push_back(static_cast<uint32_t>(i));
+                }
+
+                // one spare slot so a kernel writing past _Count is caught
+                std::vector<uint32_t> hits(count + 1, ~uint32_t(0));
+                size_t length = nc::query_batch(query, left.data(), top.data(), right.data(), bottom.data(),
+                    count, hits.data());
+
+                CHECK(length == expected.size());
+                CHECK(std::equal(expected.begin(), expected.end(), hits.begin()));
+                CHECK(hits[count] == ~uint32_t(0));
+
+                size_t scalar = nc::simd::query_batch<T>(query, left.data(), top.data(), right.data(),
+                    bottom.data(), count, hits.data());
+
+                CHECK(scalar == expected.size());
+                CHECK(std::equal(expected.begin(), expected.end(), hits.begin()));
+            }
+        }
+    }
+
+    template <typename T>
+    void check_array() {
+        // the fixed size node arrays take the same path as the raw pointers
+        nc::QuadTreeAABBArray<T, 7> boxes;
+        uint32_t hits[7];
+
+        for (size_t i = 0; i < 7; i++)
+            boxes.set(i, nc::QuadTreeAABB<T>(static_cast<T>(i), 0, static_cast<T>(i + 2), 1));
+
+        size_t length = nc::query_batch(nc::QuadTreeAABB<T>(3, 0, 5, 1), boxes, 7, hits);
+
+        CHECK(length == 3);
+        CHECK(length == 3 && hits[0] == 2 && hits[1] == 3 && hits[2] == 4);
+    }
+}
+
+int main() {
+    std::mt19937 random(1);
+
+    check_lengths<float>(random);
+    check_lengths<double>(random);
+    check_lengths<int32_t>(random);
+
+    check_array<float>();
+    check_array<double>();
+    check_array<int32_t>();
+
+    return nc_test::finish("kernel_test");
+}
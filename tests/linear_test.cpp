@@ -0,0 +1,139 @@
+// ================================= //
+//                                   //
+// QuadTree Version 0.1a             //
+// Copyright (c)2017 NuclearC        //
+//                                   //
+// ================================= //
+
+// QuadTreeLinear against a scan of its live objects while random
+// inserts, removes and updates run, for int, float and double, in a
+// space that does not start at the origin. boxes range from flat ones to
+// a fifth of the space and some reach its far edge
+
+#include "../quadtree_linear.h"
+#include "check.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace {
+    template <typename T>
+    void check_type() {
+        using Linear = nc::QuadTreeLinear<T>;
+        using ObjectPtr = typename Linear::ObjectPtr;
+        using Box = nc::QuadTreeAABB<T>;
+
+        const Box space(-300, -200, 700, 800);
+        Linear linear(space);
+
+        std::mt19937 random(1);
+        std::uniform_int_distribution<int> position(-299, 690);
+        std::uniform_int_distribution<int> row(-199, 790);
+        std::uniform_int_distribution<int> extent(0, 10);
+
+        auto make_box = [&](size_t _Index) {
+            const T x = T(position(random)), y = T(row(random));
+            const T size = T(_Index % 17 == 0 ? 200 : extent(random));
+            return Box(x, y, std::min(T(700), T(x + size)), std::min(T(800), T(y + size)));
+        };
+
+        std::vector<ObjectPtr> live, pending;
+
+        for (size_t i = 0; i < 6000; i++)
+            live.push_back(std::make_shared<nc::QuadTreeObject<T>>(make_box(i), nullptr, i));
+
+        // build() replaces whatever was inserted before
+        for (size_t i = 0; i < 100; i++)
+            CHECK(linear.insert(std::make_shared<nc::QuadTreeObject<T>>(make_box(i), nullptr, 100000 + i)));
+
+        std::vector<ObjectPtr> input = live;
+        input.push_back(std::make_shared<nc::QuadTreeObject<T>>(Box(800, 900, 810, 910), nullptr, 200000));
+
+        CHECK(linear.build(input.begin(), input.end()) == live.size());
+        CHECK(linear.get_total_objects() == live.size());
+        CHECK(!linear.insert(input.back()));
+
+        size_t next_id = live.size();
+
+        auto check_queries = [&](int _Count) {
+            for (int q = 0; q < _Count; q++) {
+                const T x = T(position(random)), y = T(row(random));
+                const T size = T(q % 3 == 0 ? 2 : (q % 3 == 1 ? 40 : 400));
+                const Box query(x, y, T(x + size), T(y + size));
+
+                std::vector<ObjectPtr> result;
+                linear.query(query, result);
+
+                std::vector<size_t> ids, expected;
+
+                for (const ObjectPtr& object : result)
+                    ids.push_back(object->id);
+
+                for (const ObjectPtr& object : live) {
+                    if (object->bounds.intersects(query))
+                        expected.push_back(object->id);
+                }
+
+                std::sort(ids.begin(), ids.end());
+                std::sort(expected.begin(), expected.end());
+                CHECK(ids == expected);
+            }
+        };
+
+        check_queries(100);
+
+        for (int round = 0; round < 20; round++) {
+            for (int k = 0; k < 200; k++) {
+                const size_t i = random() % live.size();
+
+                switch (random() % 4) {
+                case 0:
+                    CHECK(linear.remove(live[i]));
+                    CHECK(!linear.remove(live[i]));
+                    live[i] = live.back();
+                    live.pop_back();
+                    break;
+                case 1: {
+                    // small moves mostly keep the cell, far ones do not
+                    Box bounds = make_box(i);
+
+                    if (k % 2) {
+                        const Box& old = live[i]->bounds;
+                        bounds = Box(old.left, old.top, std::min(T(700), T(old.right + 1)), old.bottom);
+                    }
+
+                    CHECK(linear.update(live[i], bounds));
+                    CHECK(live[i]->bounds == bounds);
+                    break;
+                }
+                default:
+                    live.push_back(std::make_shared<nc::QuadTreeObject<T>>(make_box(next_id), nullptr, next_id));
+                    next_id++;
+                    CHECK(linear.insert(live.back()));
+                    break;
+                }
+            }
+
+            CHECK(linear.get_total_objects() == live.size());
+            check_queries(20);
+        }
+
+        // stopping early
+        size_t calls = 0;
+        CHECK(!linear.query(space, [&](const ObjectPtr&) { return ++calls < 5; }));
+        CHECK(calls == 5);
+
+        linear.clear();
+        live.clear();
+        check_queries(5);
+    }
+}
+
+int main() {
+    check_type<int>();
+    check_type<float>();
+    check_type<double>();
+
+    return nc_test::finish("linear_test");
+}
@@ -0,0 +1,94 @@
+// ================================= //
+//                                   //
+// QuadTree Version 0.1a             //
+// Copyright (c)2017 NuclearC        //
+//                                   //
+// ================================= //
+
+// nearest() against the sorted distances to every object, for int, float
+// and double trees, with and without a distance limit and with query
+// points inside and outside the tree
+
+#include "../quadtree.h"
+#include "check.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+namespace {
+    template <typename T>
+    typename nc::QuadTree<T, 4>::Distance distance_to(const nc::QuadTreeAABB<T>& _Bounds, T _X, T _Y) {
+        using Distance = typename nc::QuadTree<T, 4>::Distance;
+
+        const Distance dx = std::max({ Distance(_Bounds.left) - Distance(_X), Distance(0), Distance(_X) - Distance(_Bounds.right) });
+        const Distance dy = std::max({ Distance(_Bounds.top) - Distance(_Y), Distance(0), Distance(_Y) - Distance(_Bounds.bottom) });
+        return std::sqrt(dx * dx + dy * dy);
+    }
+
+    template <typename T>
+    void check_type() {
+        using Tree = nc::QuadTree<T, 4>;
+        using Distance = typename Tree::Distance;
+
+        std::mt19937 random(1);
+        std::uniform_int_distribution<int> position(0, 990);
+        std::uniform_int_distribution<int> extent(1, 5);
+
+        Tree tree(nc::QuadTreeAABB<T>(0, 0, 1000, 1000));
+        std::vector<typename Tree::ObjectPtr> objects;
+        std::vector<typename Tree::Neighbor> neighbors;
+
+        tree.nearest(T(10), T(10), 5, neighbors);
+        CHECK(neighbors.empty());
+
+        for (size_t i = 0; i < 10000; i++) {
+            const T x = T(position(random)), y = T(position(random));
+            objects.push_back(std::make_shared<typename Tree::Object>(
+                nc::QuadTreeAABB<T>(x, y, T(x + extent(random)), T(y + extent(random))), nullptr, i));
+            tree.insert(objects.back());
+        }
+
+        std::uniform_int_distribution<int> point(-50, 1050);
+
+        for (int q = 0; q < 150; q++) {
+            const T x = T(point(random)), y = T(point(random));
+            const size_t count = q % 25 == 0 ? 0 : 1 + q % 12;
+            const Distance limit = q % 3 == 0 ? Distance(15) : std::numeric_limits<Distance>::max();
+
+            tree.nearest(x, y, count, neighbors, limit);
+
+            std::vector<Distance> expected;
+
+            for (const auto& object : objects) {
+                const Distance d = distance_to(object->bounds, x, y);
+
+                if (d <= limit)
+                    expected.push_back(d);
+            }
+
+            std::sort(expected.begin(), expected.end());
+            expected.resize(std::min(count, expected.size()));
+
+            CHECK(neighbors.size() == expected.size());
+
+            for (size_t i = 0; i < neighbors.size() && i < expected.size(); i++) {
+                CHECK(std::fabs(neighbors[i].distance - expected[i]) < 1e-4);
+                CHECK(std::fabs(neighbors[i].distance - distance_to(neighbors[i].object->bounds, x, y)) < 1e-4);
+
+                for (size_t k = 0; k < i; k++)
+                    CHECK(neighbors[k].object != neighbors[i].object);
+            }
+        }
+    }
+}
+
+int main() {
+    check_type<int>();
+    check_type<float>();
+    check_type<double>();
+
+    return nc_test::finish("nearest_test");
+}
@@ -0,0 +1,111 @@
+// ================================= //
+//                                   //
+// QuadTree Version 0.1a             //
+// Copyright (c)2017 NuclearC        //
+//                                   //
+// ================================= //
+
+// for_each_overlapping_pair() against all pairs of objects, within one
+// tree and between two trees of different capacity. every pair has to
+// be reported exactly once, and returning false has to stop the search
+
+#include "../quadtree.h"
+#include "check.h"
+
+#include <algorithm>
+#include <random>
+#include <set>
+#include <utility>
+#include <vector>
+
+namespace {
+    using Box = nc::QuadTreeAABB<float>;
+    using Object = nc::QuadTreeObject<float>;
+    using ObjectPtr = std::shared_ptr<Object>;
+    using Pair = std::pair<size_t, size_t>;
+
+    // integer coordinates, so plenty of boxes only touch
+    template <typename _Tree>
+    std::vector<ObjectPtr> fill(_Tree& _Target, size_t _Count, int _Extent, unsigned _Seed) {
+        std::mt19937 random(_Seed);
+        std::uniform_int_distribution<int> position(1, 480);
+        std::uniform_int_distribution<int> extent(1, _Extent);
+        std::vector<ObjectPtr> objects;
+
+        for (size_t i = 0; i < _Count; i++) {
+            const float x = float(position(random)), y = float(position(random));
+            objects.push_back(std::make_shared<Object>(Box(x, y, x + extent(random), y + extent(random)), nullptr, i));
+            CHECK(_Target.insert(objects.back()));
+        }
+
+        return objects;
+    }
+}
+
+int main() {
+    nc::QuadTree<float, 4> first(Box(0, 0, 512, 512));
+    nc::QuadTree<float, 2> second(Box(0, 0, 512, 512));
+
+    const std::vector<ObjectPtr> objects = fill(first, 3000, 12, 1);
+    const std::vector<ObjectPtr> others = fill(second, 2000, 4, 2);
+
+    std::set<Pair> expected;
+
+    for (size_t i = 0; i < objects.size(); i++) {
+        for (size_t j = i + 1; j < objects.size(); j++) {
+            if (objects[i]->bounds.intersects(objects[j]->bounds))
+                expected.insert(Pair(i, j));
+        }
+    }
+
+    std::set<Pair> found;
+    size_t calls = 0;
+
+    CHECK(first.for_each_overlapping_pair([&](const ObjectPtr& _A, const ObjectPtr& _B) {
+        calls++;
+        CHECK(_A != _B);
+        found.insert(Pair(std::min(_A->id, _B->id), std::max(_A->id, _B->id)));
+    }));
+
+    CHECK(found == expected);
+    CHECK(calls == expected.size());
+
+    expected.clear();
+
+    for (const ObjectPtr& a : objects) {
+        for (const ObjectPtr& b : others) {
+            if (a->bounds.intersects(b->bounds))
+                expected.insert(Pair(a->id, b->id));
+        }
+    }
+
+    found.clear();
+    calls = 0;
+
+    // objects of first come first
+    CHECK(first.for_each_overlapping_pair(second, [&](const ObjectPtr& _A, const ObjectPtr& _B) {
+        calls++;
+        CHECK(_A == objects[_A->id] && _B == others[_B->id]);
+        found.insert(Pair(_A->id, _B->id));
+    }));
+
+    CHECK(found == expected);
+    CHECK(calls == expected.size());
+
+    calls = 0;
+    CHECK(!first.for_each_overlapping_pair([&](const ObjectPtr&, const ObjectPtr&) { return ++calls < 10; }));
+    CHECK(calls == 10);
+
+    calls = 0;
+    CHECK(!first.for_each_overlapping_pair(second, [&](const ObjectPtr&, const ObjectPtr&) { return ++calls < 10; }));
+    CHECK(calls == 10);
+
+    // an empty tree has no pairs with anything
+    nc::QuadTree<float, 2> empty(Box(0, 0, 512, 512));
+    calls = 0;
+    CHECK(empty.for_each_overlapping_pair([&](const ObjectPtr&, const ObjectPtr&) { calls++; }));
+    CHECK(first.for_each_overlapping_pair(empty, [&](const ObjectPtr&, const ObjectPtr&) { calls++; }));
+    CHECK(calls == 0);
+
+    return nc_test::finish("pairs_test");
+}
@@ -0,0 +1,125 @@
+// ================================= //
+//                                   //
+// QuadTree Version 0.1a             //
+// Copyright (c)2017 NuclearC        //
+//                                   //
+// ================================= //
+
+// parallel_query() against a scan of all objects, for small and large
+// query boxes and grains, also from several threads at once. the worker
+// pool has to hand back exceptions and run every task exactly once
+
+#include "../quadtree.h"
+#include "check.h"
+
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+namespace {
+    using Tree = nc::QuadTree<double, 8>;
+    using ObjectPtr = Tree::ObjectPtr;
+
+    std::vector<size_t> brute_force(const std::vector<ObjectPtr>& _Objects, const nc::QuadTreeAABB<double>& _Bounds) {
+        std::vector<size_t> ids;
+
+        for (const ObjectPtr& object : _Objects) {
+            if (object->bounds.intersects(_Bounds))
+                ids.push_back(object->id);
+        }
+
+        return ids;
+    }
+
+    std::vector<size_t> sorted_ids(const std::vector<ObjectPtr>& _Objects) {
+        std::vector<size_t> ids;
+
+        for (const ObjectPtr& object : _Objects)
+            ids.push_back(object->id);
+
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    }
+
+    void check_queries(const Tree& _Tree, const std::vector<ObjectPtr>& _Objects, unsigned _Seed) {
+        std::mt19937 random(_Seed);
+        std::uniform_real_distribution<double> position(0, 1000);
+
+        for (int i = 0; i < 40; i++) {
+            const double size = i % 3 == 0 ? 5 : (i % 3 == 1 ? 100 : 700);
+            const double x = position(random), y = position(random);
+            const nc::QuadTreeAABB<double> query(x, y, x + size, y + size);
+            const size_t grain = i % 2 ? 64 : 4096;
+
+            std::vector<ObjectPtr> result;
+            _Tree.parallel_query(query, result, 4, grain);
+
+            CHECK(sorted_ids(result) == brute_force(_Objects, query));
+        }
+    }
+}
+
+int main() {
+    std::mt19937 random(1);
+    std::uniform_real_distribution<double> position(0, 995);
+
+    Tree tree(nc::QuadTreeAABB<double>(0, 0, 1000, 1000));
+    std::vector<ObjectPtr> objects;
+
+    for (size_t i = 0; i < 60000; i++) {
+        const double x = position(random), y = position(random);
+        objects.push_back(std::make_shared<Tree::Object>(nc::QuadTreeAABB<double>(x, y, x + 2, y + 2), nullptr, i));
+    }
+
+    tree.build(objects.begin(), objects.end(), 4);
+    CHECK(tree.get_total_objects() == objects.size());
+
+    check_queries(tree, objects, 2);
+
+    // a second caller while the pool is busy runs its tasks itself
+    std::vector<std::thread> threads;
+
+    for (unsigned i = 0; i < 3; i++)
+        threads.emplace_back(check_queries, std::cref(tree), std::cref(objects), 10 + i);
+
+    for (std::thread& thread : threads)
+        thread.join();
+
+    nc::QuadTreeWorkers& workers = nc::QuadTreeWorkers::get();
+
+    std::vector<std::atomic<int>> runs(1000);
+
+    for (std::atomic<int>& count : runs)
+        count = 0;
+
+    workers.run(runs.size(), 4, [&](size_t _Task, size_t _Worker) {
+        CHECK(_Worker < 4);
+        runs[_Task]++;
+    });
+
+    CHECK(std::all_of(runs.begin(), runs.end(), [](const std::atomic<int>& _Count) { return _Count == 1; }));
+
+    bool thrown = false;
+
+    try {
+        workers.run(100, 4, [](size_t _Task, size_t) {
+            if (_Task == 37)
+                throw std::runtime_error("task failed");
+        });
+    }
+    catch (const std::runtime_error&) {
+        thrown = true;
+    }
+
+    CHECK(thrown);
+
+    // the pool is still usable afterwards
+    std::atomic<size_t> count(0);
+    workers.run(50, 4, [&](size_t, size_t) { count++; });
+    CHECK(count == 50);
+
+    return nc_test::finish("parallel_test");
+}
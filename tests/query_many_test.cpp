@@ -0,0 +1,92 @@
+// ================================= //
+//                                   //
+// QuadTree Version 0.1a             //
+// Copyright (c)2017 NuclearC        //
+//                                   //
+// ================================= //
+
+// query_many() against a scan of all objects for each query, with
+// integer coordinates so boxes often just touch, and against query() for
+// the order inside each run
+
+#include "../quadtree.h"
+#include "check.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+namespace {
+    using Tree = nc::QuadTree<float, 4>;
+    using ObjectPtr = Tree::ObjectPtr;
+    using Box = nc::QuadTreeAABB<float>;
+
+    std::vector<size_t> brute_force(const std::vector<ObjectPtr>& _Objects, const Box& _Bounds) {
+        std::vector<size_t> ids;
+
+        for (const ObjectPtr& object : _Objects) {
+            if (object->bounds.intersects(_Bounds))
+                ids.push_back(object->id);
+        }
+
+        return ids;
+    }
+}
+
+int main() {
+    std::mt19937 random(3);
+    std::uniform_int_distribution<int> position(1, 249);
+    std::uniform_int_distribution<int> extent(0, 6);
+
+    Tree tree(Box(0, 0, 256, 256));
+    std::vector<ObjectPtr> objects;
+
+    // boxes stay off the root edge, a flat box on it overlaps nothing
+    for (size_t i = 0; i < 8000; i++) {
+        const float x = float(position(random)), y = float(position(random));
+        objects.push_back(std::make_shared<Tree::Object>(Box(x, y, x + extent(random), y + extent(random)), nullptr, i));
+        CHECK(tree.insert(objects.back()));
+    }
+
+    std::vector<Box> queries;
+    std::uniform_int_distribution<int> size(0, 40);
+
+    for (size_t i = 0; i < 600; i++) {
+        const float x = float(position(random)) - 20, y = float(position(random)) - 20;
+        queries.push_back(Box(x, y, x + size(random), y + size(random)));
+    }
+
+    // outside the tree, the whole tree and a repeat
+    queries.push_back(Box(300, 300, 310, 310));
+    queries.push_back(Box(0, 0, 256, 256));
+    queries.push_back(queries.front());
+
+    std::vector<size_t> offsets;
+    std::vector<ObjectPtr> result;
+    tree.query_many(queries, offsets, result);
+
+    CHECK(offsets.size() == queries.size() + 1);
+    CHECK(offsets.front() == 0 && offsets.back() == result.size());
+
+    for (size_t i = 0; i < queries.size(); i++) {
+        std::vector<size_t> ids;
+
+        for (size_t k = offsets[i]; k < offsets[i + 1]; k++)
+            ids.push_back(result[k]->id);
+
+        std::sort(ids.begin(), ids.end());
+        CHECK(ids == brute_force(objects, queries[i]));
+
+        std::vector<ObjectPtr> single;
+        tree.query(queries[i], single);
+        CHECK(std::equal(single.begin(), single.end(), result.begin() + offsets[i]));
+    }
+
+    CHECK(offsets[queries.size() - 1] - offsets[queries.size() - 2] == objects.size());
+
+    // no queries leaves one offset and no objects
+    tree.query_many(nullptr, 0, offsets, result);
+    CHECK(offsets.size() == 1 && offsets[0] == 0 && result.empty());
+
+    return nc_test::finish("query_many_test");
+}
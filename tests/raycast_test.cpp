@@ -0,0 +1,130 @@
+// ================================= //
+//                                   //
+// QuadTree Version 0.1a             //
+// Copyright (c)2017 NuclearC        //
+//                                   //
+// ================================= //
+
+// raycast() against a slab test of the ray with every object, including
+// rays along an axis and rays starting outside the tree. the hits have
+// to come in order of entry and stopping at the first one has to stop
+
+#include "../quadtree.h"
+#include "check.h"
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <random>
+#include <vector>
+
+namespace {
+    using Tree = nc::QuadTree<double, 4>;
+    using ObjectPtr = Tree::ObjectPtr;
+
+    // entry t of the ray into _Bounds, or a negative value for a miss
+    double slab(const nc::QuadTreeAABB<double>& _Bounds, const double* _Origin, const double* _Direction, double _MaxT) {
+        const double low[2] = { _Bounds.left, _Bounds.top };
+        const double high[2] = { _Bounds.right, _Bounds.bottom };
+        double enter = 0, leave = _MaxT;
+
+        for (int axis = 0; axis < 2; axis++) {
+            if (_Direction[axis] == 0) {
+                if (_Origin[axis] < low[axis] || _Origin[axis] > high[axis])
+                    return -1;
+                continue;
+            }
+
+            double t0 = (low[axis] - _Origin[axis]) / _Direction[axis];
+            double t1 = (high[axis] - _Origin[axis]) / _Direction[axis];
+
+            if (t0 > t1)
+                std::swap(t0, t1);
+
+            enter = std::max(enter, t0);
+            leave = std::min(leave, t1);
+
+            if (enter > leave)
+                return -1;
+        }
+
+        return enter;
+    }
+}
+
+int main() {
+    std::mt19937 random(1);
+    std::uniform_real_distribution<double> position(0, 990);
+    std::uniform_real_distribution<double> extent(1, 6);
+    std::uniform_real_distribution<double> angle(0, 6.2831853);
+    std::uniform_real_distribution<double> origin(-100, 1100);
+
+    Tree tree(nc::QuadTreeAABB<double>(0, 0, 1000, 1000));
+    std::vector<ObjectPtr> objects;
+
+    for (size_t i = 0; i < 15000; i++) {
+        const double x = position(random), y = position(random);
+        objects.push_back(std::make_shared<Tree::Object>(nc::QuadTreeAABB<double>(x, y, x + extent(random), y + extent(random)), nullptr, i));
+        tree.insert(objects.back());
+    }
+
+    for (int q = 0; q < 250; q++) {
+        const double start[2] = { origin(random), origin(random) };
+        const double a = angle(random);
+        double direction[2] = { std::cos(a), std::sin(a) };
+
+        if (q % 7 == 0)
+            direction[1] = 0;
+        else if (q % 11 == 0)
+            direction[0] = 0;
+
+        const double max_t = q % 2 ? 200 : 2000;
+
+        std::map<size_t, double> expected;
+
+        for (const ObjectPtr& object : objects) {
+            const double t = slab(object->bounds, start, direction, max_t);
+
+            if (t >= 0)
+                expected[object->id] = t;
+        }
+
+        std::map<size_t, double> hits;
+        double last = 0;
+        bool ordered = true;
+
+        const bool finished = tree.raycast(start[0], start[1], direction[0], direction[1], max_t,
+            [&](const ObjectPtr& _Object, double _T) {
+                ordered = ordered && _T >= last;
+                last = _T;
+                CHECK(hits.count(_Object->id) == 0);
+                hits[_Object->id] = _T;
+            });
+
+        CHECK(finished);
+        CHECK(ordered);
+        CHECK(hits.size() == expected.size());
+
+        for (const auto& hit : hits) {
+            auto it = expected.find(hit.first);
+            CHECK(it != expected.end() && std::fabs(it->second - hit.second) < 1e-9);
+        }
+
+        double closest = max_t;
+
+        for (const auto& hit : expected)
+            closest = std::min(closest, hit.second);
+
+        size_t calls = 0;
+        const bool stopped = !tree.raycast(start[0], start[1], direction[0], direction[1], max_t,
+            [&](const ObjectPtr&, double _T) {
+                calls++;
+                CHECK(std::fabs(_T - closest) < 1e-9);
+                return false;
+            });
+
+        CHECK(expected.empty() ? !stopped && calls == 0 : stopped && calls == 1);
+    }
+
+    return nc_test::finish("raycast_test");
+}
@@ -0,0 +1,137 @@
+// ================================= //
+//                                   //
+// QuadTree Version 0.1a             //
+// Copyright (c)2017 NuclearC        //
+//                                   //
+// ================================= //
+
+// circle, oriented box and convex polygon queries against the shape test
+// applied to every object, for int, float and double trees. the oriented
+// box is also compared with the polygon through its corners, and an
+// unrotated one with a plain box query
+
+#include "../quadtree.h"
+#include "check.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <random>
+#include <vector>
+
+namespace {
+    template <typename T>
+    using ObjectPtr = std::shared_ptr<nc::QuadTreeObject<T>>;
+
+    template <typename T, typename _Shape>
+    std::vector<size_t> query_ids(const nc::QuadTree<T, 4>& _Tree, const _Shape& _Query) {
+        std::vector<ObjectPtr<T>> objects;
+        std::vector<size_t> ids;
+
+        _Tree.query(_Query, objects);
+
+        for (const ObjectPtr<T>& object : objects)
+            ids.push_back(object->id);
+
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    }
+
+    template <typename T, typename _Shape>
+    std::vector<size_t> brute_force(const std::vector<ObjectPtr<T>>& _Objects, const _Shape& _Query) {
+        std::vector<size_t> ids;
+
+        for (const ObjectPtr<T>& object : _Objects) {
+            if (_Query.intersects(object->bounds))
+                ids.push_back(object->id);
+        }
+
+        return ids;
+    }
+
+    template <typename T>
+    void check_type() {
+        using Scalar = nc::QuadTreeScalar<T>;
+        using Polygon = nc::QuadTreeConvexPolygon<T>;
+
+        nc::QuadTree<T, 4> tree(nc::QuadTreeAABB<T>(0, 0, 1000, 1000));
+        std::vector<ObjectPtr<T>> objects;
+
+        std::mt19937 random(6);
+        std::uniform_int_distribution<int> position(1, 980);
+        std::uniform_int_distribution<int> extent(1, 12);
+
+        for (size_t i = 0; i < 10000; i++) {
+            const T x = T(position(random)), y = T(position(random));
+            objects.push_back(std::make_shared<nc::QuadTreeObject<T>>(
+                nc::QuadTreeAABB<T>(x, y, T(x + extent(random)), T(y + extent(random))), nullptr, i));
+            tree.insert(objects.back());
+        }
+
+        std::uniform_real_distribution<Scalar> center(0, 1000), size(1, 80), angle(0, Scalar(6.2831853));
+
+        for (int q = 0; q < 100; q++) {
+            const Scalar x = center(random), y = center(random);
+            const Scalar half_width = size(random), half_height = size(random), a = angle(random);
+
+            const nc::QuadTreeCircle<T> circle(x, y, size(random));
+            CHECK(query_ids(tree, circle) == brute_force(objects, circle));
+
+            const nc::QuadTreeOrientedBox<T> box(x, y, half_width, half_height, a);
+            const std::vector<size_t> box_ids = query_ids(tree, box);
+            CHECK(box_ids == brute_force(objects, box));
+
+            // the same box through its corners
+            const Scalar c = std::cos(a), s = std::sin(a);
+            std::vector<typename Polygon::Vertex> corners;
+
+            for (int k = 0; k < 4; k++) {
+                const Scalar u = (k == 0 || k == 3) ? -half_width : half_width;
+                const Scalar v = k < 2 ? -half_height : half_height;
+                corners.push_back({ x + u * c - v * s, y + u * s + v * c });
+            }
+
+            const Polygon polygon(corners);
+            const std::vector<size_t> polygon_ids = query_ids(tree, polygon);
+            CHECK(polygon_ids == brute_force(objects, polygon));
+
+            // rounding in the corners may only flip objects the box just
+            // touches, a slightly larger box hits them and a smaller misses
+            std::vector<size_t> differ;
+            std::set_symmetric_difference(box_ids.begin(), box_ids.end(),
+                polygon_ids.begin(), polygon_ids.end(), std::back_inserter(differ));
+
+            const Scalar slack = Scalar(0.01);
+            const nc::QuadTreeOrientedBox<T> larger(x, y, half_width + slack, half_height + slack, a);
+            const nc::QuadTreeOrientedBox<T> smaller(x, y, half_width - slack, half_height - slack, a);
+
+            for (size_t id : differ)
+                CHECK(larger.intersects(objects[id]->bounds) && !smaller.intersects(objects[id]->bounds));
+
+            // a triangle, wound the other way round
+            const Polygon triangle({ { x, y }, { x - half_width, y + half_height }, { x + half_width, y + half_height } });
+            CHECK(query_ids(tree, triangle) == brute_force(objects, triangle));
+        }
+
+        // unrotated boxes match box queries
+        for (int q = 0; q < 50; q++) {
+            const T x = T(position(random)), y = T(position(random));
+            const T w = T(extent(random) * 4), h = T(extent(random) * 4);
+            const nc::QuadTreeOrientedBox<T> box(Scalar(x) + Scalar(w) / 2, Scalar(y) + Scalar(h) / 2,
+                Scalar(w) / 2, Scalar(h) / 2, 0);
+
+            CHECK(query_ids(tree, box) == brute_force(objects, nc::QuadTreeAABB<T>(x, y, T(x + w), T(y + h))));
+        }
+
+        // an empty polygon hits nothing
+        CHECK(query_ids(tree, Polygon()).empty());
+    }
+}
+
+int main() {
+    check_type<int>();
+    check_type<float>();
+    check_type<double>();
+
+    return nc_test::finish("shape_test");
+}
@@ -0,0 +1,190 @@
+// ================================= //
+//                                   //
+// QuadTree Version 0.1a             //
+// Copyright (c)2017 NuclearC        //
+//                                   //
+// ================================= //
+
+// QuadTreeView over serialize() output against the tree it was written
+// from, for int, float and double trees, then over damaged copies of the
+// data: those have to be rejected or still answer queries inside the
+// buffer. with NC_QUADTREE_MMAP defined the data also goes through a
+// mapped file
+
+#include "../quadtree.h"
+#include "check.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+    template <typename T>
+    std::vector<size_t> tree_ids(const nc::QuadTree<T, 4>& _Tree, const nc::QuadTreeAABB<T>& _Bounds) {
+        std::vector<typename nc::QuadTree<T, 4>::ObjectPtr> objects;
+        std::vector<size_t> ids;
+
+        _Tree.query(_Bounds, objects);
+
+        for (const auto& object : objects)
+            ids.push_back(object->id);
+
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    }
+
+    template <typename T>
+    std::vector<size_t> view_ids(const nc::QuadTreeView<T>& _View, const nc::QuadTreeAABB<T>& _Bounds) {
+        std::vector<size_t> ids;
+        _View.query(_Bounds, ids);
+
+        std::sort(ids.begin(), ids.end());
+        return ids;
+    }
+
+    template <typename T>
+    bool rejected(const void* _Data, size_t _Size) {
+        try {
+            nc::QuadTreeView<T> view(_Data, _Size);
+        }
+        catch (const std::invalid_argument&) {
+            return true;
+        }
+
+        return false;
+    }
+
+    template <typename T>
+    void check_type() {
+        nc::QuadTreeSplitPolicy<T> policy;
+        policy.max_depth = 6;
+
+        nc::QuadTree<T, 4> tree(nc::QuadTreeAABB<T>(0, 0, 1000, 1000), policy);
+        std::vector<typename nc::QuadTree<T, 4>::ObjectPtr> objects;
+
+        std::mt19937 random(1);
+        std::uniform_int_distribution<int> position(1, 980);
+
+        // a stack of equal boxes fills the depth limited leaves
+        for (size_t i = 0; i < 8000; i++) {
+            T x = T(position(random)), y = T(position(random));
+
+            if (i % 5 == 0)
+                x = y = T(500);
+
+            objects.push_back(std::make_shared<nc::QuadTreeObject<T>>(nc::QuadTreeAABB<T>(x, y, x + 3, y + 3), nullptr, i * 3));
+            tree.insert(objects.back());
+        }
+
+        for (size_t i = 0; i < objects.size(); i += 3)
+            tree.remove(objects[i]);
+
+        std::vector<uint8_t> data;
+        tree.serialize(data);
+
+        nc::QuadTreeView<T> view(data.data(), data.size());
+        CHECK(view.get_total_objects() == tree.get_total_objects());
+
+        for (int q = 0; q < 200; q++) {
+            const T x = T(position(random)), y = T(position(random));
+            const nc::QuadTreeAABB<T> query(x, y, x + 40, y + 40);
+            CHECK(view_ids(view, query) == tree_ids(tree, query));
+        }
+
+        const nc::QuadTreeAABB<T> everything(0, 0, 1000, 1000);
+        const std::vector<size_t> all = view_ids(view, everything);
+        CHECK(all == tree_ids(tree, everything));
+
+        // truncated data and the wrong coordinate type
+        CHECK(rejected<T>(data.data(), 10));
+        CHECK(rejected<T>(data.data(), data.size() - 1));
+        CHECK(rejected<T>(nullptr, 0));
+
+        if (std::is_floating_point<T>::value)
+            CHECK(rejected<int>(data.data(), data.size()));
+        else
+            CHECK(rejected<float>(data.data(), data.size()));
+
+        // damaged node records. whatever a view accepts has to stay inside
+        // the buffer (the sanitizer builds catch that) and only report ids
+        // that were written
+        const nc::QuadTreeFileHeader& header = *reinterpret_cast<const nc::QuadTreeFileHeader*>(data.data());
+        const size_t nodes_begin = size_t(header.nodes);
+        const size_t nodes_end = nodes_begin + size_t(header.node_count) * sizeof(nc::QuadTreeFlatNode<T>);
+        const std::set<size_t> written(all.begin(), all.end());
+
+        size_t accepted = 0;
+
+        for (int round = 0; round < 1500; round++) {
+            std::vector<uint8_t> damaged = data;
+
+            for (int flip = 0; flip < 1 + round % 3; flip++)
+                damaged[nodes_begin + random() % (nodes_end - nodes_begin)] = uint8_t(random());
+
+            // a child link back to an earlier node
+            if (round % 50 == 0) {
+                nc::QuadTreeFlatNode<T>* flat = reinterpret_cast<nc::QuadTreeFlatNode<T>*>(damaged.data() + nodes_begin);
+                const size_t at = 1 + random() % (header.node_count - 1);
+                flat[at].first_child = uint32_t(random() % (at + 1));
+                flat[at].child_count = 1;
+                CHECK(rejected<T>(damaged.data(), damaged.size()));
+                continue;
+            }
+
+            try {
+                nc::QuadTreeView<T> accepted_view(damaged.data(), damaged.size());
+                std::vector<size_t> ids;
+                accepted_view.query(nc::QuadTreeAABB<T>(-2000, -2000, 3000, 3000), ids);
+
+                for (size_t id : ids)
+                    CHECK(written.count(id) == 1);
+
+                accepted++;
+            }
+            catch (const std::invalid_argument&) {
+            }
+        }
+
+        CHECK(accepted > 0);
+
+        // an empty tree still gives a valid view
+        nc::QuadTree<T, 4> empty(nc::QuadTreeAABB<T>(0, 0, 1, 1));
+        empty.serialize(data);
+
+        nc::QuadTreeView<T> empty_view(data.data(), data.size());
+        CHECK(empty_view.get_total_objects() == 0);
+        CHECK(view_ids(empty_view, everything).empty());
+
+#if defined(NC_QUADTREE_MMAP)
+        tree.serialize(data);
+
+        const char* path = "view_test.bin";
+        std::FILE* file = std::fopen(path, "wb");
+        CHECK(file != nullptr);
+
+        if (file) {
+            std::fwrite(data.data(), 1, data.size(), file);
+            std::fclose(file);
+
+            {
+                nc::QuadTreeMappedFile mapped(path);
+                nc::QuadTreeView<T> mapped_view(mapped.get_data(), mapped.get_size());
+                CHECK(view_ids(mapped_view, everything) == all);
+            }
+
+            std::remove(path);
+        }
+#endif
+    }
+}
+
+int main() {
+    check_type<int>();
+    check_type<float>();
+    check_type<double>();
+
+    return nc_test::finish("view_test");
+}